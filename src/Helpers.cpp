@@ -1,5 +1,12 @@
 #include "Helpers.h"
 
+#include <set>
+#include <map>
+#include <queue>
+#include <cstring>
+#include <climits>
+#include <sstream>
+
 void VertexArrayObject::init()
 {
   glGenVertexArrays(1, &id);
@@ -74,22 +81,69 @@ void IndexBufferObject::update(const Eigen::VectorXi& V)
   check_gl_error();
 }
 
+void TextureBufferObject::init()
+{
+  glGenBuffers(1,&buffer);
+  glGenTextures(1,&id);
+  check_gl_error();
+}
+
+void TextureBufferObject::update(const Eigen::MatrixXf& M)
+{
+  assert(id != 0 && M.rows() == 4);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(float)*M.size(), M.data(), GL_DYNAMIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, id);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+  cols = M.cols();
+  check_gl_error();
+}
+
+void TextureBufferObject::update(int first, const Eigen::MatrixXf& M)
+{
+  assert(id != 0 && M.rows() == 4 && first+M.cols() <= cols);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferSubData(GL_TEXTURE_BUFFER, sizeof(float)*4*first, sizeof(float)*M.size(), M.data());
+  check_gl_error();
+}
+
+void TextureBufferObject::bind(int unit)
+{
+  glActiveTexture(GL_TEXTURE0+unit);
+  glBindTexture(GL_TEXTURE_BUFFER, id);
+  check_gl_error();
+}
+
+void TextureBufferObject::free()
+{
+  glDeleteTextures(1,&id);
+  glDeleteBuffers(1,&buffer);
+  check_gl_error();
+}
+
 bool Program::init(
   const std::string &vertex_shader_string,
   const std::string &fragment_shader_string,
-  const std::string &fragment_data_name)
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string)
 {
   using namespace std;
+  uniforms.clear();
   vertex_shader = create_shader_helper(GL_VERTEX_SHADER, vertex_shader_string);
   fragment_shader = create_shader_helper(GL_FRAGMENT_SHADER, fragment_shader_string);
+  geometry_shader = create_shader_helper(GL_GEOMETRY_SHADER, geometry_shader_string);
 
   if (!vertex_shader || !fragment_shader)
     return false;
+  if (!geometry_shader && !geometry_shader_string.empty())
+    return false;
 
   program_shader = glCreateProgram();
 
   glAttachShader(program_shader, vertex_shader);
   glAttachShader(program_shader, fragment_shader);
+  if (geometry_shader)
+    glAttachShader(program_shader, geometry_shader);
 
   glBindFragDataLocation(program_shader, 0, fragment_data_name.c_str());
   glLinkProgram(program_shader);
@@ -123,7 +177,10 @@ GLint Program::attrib(const std::string &name) const
 
 GLint Program::uniform(const std::string &name) const
 {
-  return glGetUniformLocation(program_shader, name.c_str());
+  auto it = uniforms.find(name);
+  if (it == uniforms.end())
+    it = uniforms.insert(std::make_pair(name, glGetUniformLocation(program_shader, name.c_str()))).first;
+  return it->second;
 }
 
 GLint Program::bindVertexAttribArray(
@@ -147,6 +204,7 @@ GLint Program::bindVertexAttribArray(
 
 void Program::free()
 {
+  uniforms.clear();
   if (program_shader)
   {
     glDeleteProgram(program_shader);
@@ -162,6 +220,11 @@ void Program::free()
     glDeleteShader(fragment_shader);
     fragment_shader = 0;
   }
+  if (geometry_shader)
+  {
+    glDeleteShader(geometry_shader);
+    geometry_shader = 0;
+  }
   check_gl_error();
 }
 
@@ -235,20 +298,29 @@ bool loadMeshfromOFF(std::string filepath, Eigen::MatrixXd &V, Eigen::MatrixXd &
     std::string dummy;
     inFile >> dummy >> vnums >> fnums >> enums;
 
-    // Read vertexes
-    V = Eigen::MatrixXd(4, 0);
+    // Read vertexes, a COFF file follows them with a colour, 0-255 or 0-1 with an optional alpha
+    V = Eigen::MatrixXd(4, vnums);
+    C = Eigen::MatrixXd(3, dummy == "COFF"? vnums : 0);
     for (int i = 0; i < vnums; i++) {
         double x,y,z;
         inFile >> x >> y >> z;
-        V.conservativeResize(V.rows(), V.cols()+1);
         V.col(i) = Eigen::Vector4d(x, y, z, 1);
+        if (C.cols() == 0) continue;
+        std::string rest;
+        std::getline(inFile, rest);
+        std::istringstream color(rest);
+        double r = 255, g = 255, b = 255;
+        color >> r >> g >> b;
+        C.col(i) = Eigen::Vector3d(r, g, b);
     }
+    if (C.cols() > 0 && C.maxCoeff() <= 1.) C *= 255.;
 
     std::cout << vnums << " vertexes loaded" << std::endl;
     
     // Read faces and create face objects
     // Add color to each face
     std::vector<int> indices;
+    indices.reserve(3*fnums);
     for (int t = 0; t < fnums; t++) {
         int n, i,j,k;
         inFile >> n >> i >> j >> k;
@@ -264,6 +336,281 @@ bool loadMeshfromOFF(std::string filepath, Eigen::MatrixXd &V, Eigen::MatrixXd &
     return true;
 }
 
+// quadric of the plane through a with normal n, scaled by weight
+static Eigen::Matrix4d plane_quadric(Eigen::Vector3d a, Eigen::Vector3d n, double weight) {
+  Eigen::Vector4d p(n.x(), n.y(), n.z(), -n.dot(a));
+  return weight*p*p.transpose();
+}
+
+// the best place for the vertex merging both ends of an edge and its error
+static double collapse_cost(const Eigen::Matrix4d &Q, Eigen::Vector3d a, Eigen::Vector3d b, Eigen::Vector3d &pos) {
+  Eigen::Matrix4d A = Q;
+  A.row(3) = Eigen::Vector4d(0, 0, 0, 1);
+  if (fabs(A.determinant()) > 1e-12) {
+    Eigen::Vector4d x = A.inverse()*Eigen::Vector4d(0, 0, 0, 1);
+    pos = x.head<3>();
+    return fmax(x.dot(Q*x), 0.);
+  }
+  // singular quadric, fall back to the ends and the middle
+  double best = -1;
+  Eigen::Vector3d candidates[3] = {a, b, (a+b)/2.};
+  for (Eigen::Vector3d c: candidates) {
+    Eigen::Vector4d x(c.x(), c.y(), c.z(), 1);
+    double cost = fmax(x.dot(Q*x), 0.);
+    if (best < 0 || cost < best) {
+      best = cost;
+      pos = c;
+    }
+  }
+  return best;
+}
+
+// Quadric edge collapse (Garland and Heckbert). Edges are popped from a priority queue by
+// their quadric error, entries made stale by an earlier collapse are recognized by the
+// version of their end vertices. Stops at targetFaces faces or when the cheapest collapse
+// moves the surface more than maxError (a fraction of the bounding box diagonal, <= 0 for no bound).
+// The vertex colours C, if there is one per vertex, are blended by area along with the collapses.
+void decimate_mesh(Eigen::MatrixXd &V, Eigen::MatrixXd &C, Eigen::VectorXi &IDX, int targetFaces, double maxError) {
+  int vnums = V.cols(), fnums = IDX.rows()/3;
+  if (fnums <= targetFaces) return;
+  std::cout << "Decimating " << fnums << " faces..." << std::endl;
+
+  Eigen::MatrixXd P = V.topRows(3);
+  std::vector<std::vector<int>> vfaces(vnums);
+  std::vector<bool> faceAlive(fnums, true), vertAlive(vnums, true);
+  std::vector<int> version(vnums, 0);
+  std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> Q(vnums, Eigen::Matrix4d::Zero());
+  // area summed into each quadric, turns the error back into a squared distance
+  std::vector<double> W(vnums, 0.);
+  // every half edge as ((smaller vid, larger vid), face), sorted so twins are next to each other
+  std::vector<std::pair<std::pair<int, int>, int>> halfEdges;
+  halfEdges.reserve(3*fnums);
+  for (int f = 0; f < fnums; f++) {
+    Eigen::Vector3d a = P.col(IDX(3*f)), b = P.col(IDX(3*f+1)), c = P.col(IDX(3*f+2));
+    Eigen::Vector3d n = (b-a).cross(c-a);
+    double area = n.norm();
+    if (area > 0) n /= area;
+    Eigen::Matrix4d Kp = plane_quadric(a, n, area);
+    for (int k = 0; k < 3; k++) {
+      int v1 = IDX(3*f+k), v2 = IDX(3*f+(k+1)%3);
+      Q[v1] += Kp;
+      W[v1] += area;
+      vfaces[v1].push_back(f);
+      halfEdges.push_back(std::make_pair(std::make_pair(std::min(v1, v2), std::max(v1, v2)), f));
+    }
+  }
+  std::sort(halfEdges.begin(), halfEdges.end());
+  for (int i = 0; i < halfEdges.size(); i++) {
+    bool first = i == 0 || halfEdges[i-1].first != halfEdges[i].first;
+    bool last = i+1 == halfEdges.size() || halfEdges[i+1].first != halfEdges[i].first;
+    if (!first || !last) continue;
+    // boundary edges get a perpendicular plane so the open borders keep their shape
+    int f = halfEdges[i].second, v1 = halfEdges[i].first.first, v2 = halfEdges[i].first.second;
+    Eigen::Vector3d a = P.col(IDX(3*f)), b = P.col(IDX(3*f+1)), c = P.col(IDX(3*f+2));
+    Eigen::Vector3d e = P.col(v2)-P.col(v1);
+    Eigen::Vector3d side = e.cross((b-a).cross(c-a));
+    if (side.norm() == 0) continue;
+    Eigen::Matrix4d Kb = plane_quadric(P.col(v1), side.normalized(), 1000.*e.squaredNorm());
+    Q[v1] += Kb;
+    Q[v2] += Kb;
+  }
+
+  // kept small since the queue holds millions of them, the position is solved again when popped
+  struct Collapse {
+    double cost;
+    int v1, v2, ver1, ver2;
+    bool operator<(const Collapse &other) const { return cost > other.cost; }
+  };
+  auto make_collapse = [&](int v1, int v2) {
+    Collapse c;
+    Eigen::Vector3d pos;
+    c.cost = collapse_cost(Q[v1]+Q[v2], P.col(v1), P.col(v2), pos);
+    c.v1 = v1; c.v2 = v2; c.ver1 = version[v1]; c.ver2 = version[v2];
+    return c;
+  };
+  std::vector<Collapse> initial;
+  initial.reserve(halfEdges.size()/2+1);
+  for (int i = 0; i < halfEdges.size(); i++) {
+    if (i == 0 || halfEdges[i-1].first != halfEdges[i].first) initial.push_back(make_collapse(halfEdges[i].first.first, halfEdges[i].first.second));
+  }
+  std::vector<std::pair<std::pair<int, int>, int>>().swap(halfEdges);
+  std::priority_queue<Collapse> pq(std::less<Collapse>(), std::move(initial));
+
+  double diag = (P.rowwise().maxCoeff()-P.rowwise().minCoeff()).norm();
+  double maxCost = maxError > 0? pow(maxError*diag, 2) : -1;
+  auto neighbours = [&](int v) {
+    std::vector<int> nebs;
+    for (int f: vfaces[v]) {
+      if (!faceAlive[f]) continue;
+      for (int k = 0; k < 3; k++) {
+        if (IDX(3*f+k) != v) nebs.push_back(IDX(3*f+k));
+      }
+    }
+    std::sort(nebs.begin(), nebs.end());
+    nebs.erase(std::unique(nebs.begin(), nebs.end()), nebs.end());
+    return nebs;
+  };
+
+  int faceLeft = fnums;
+  while (faceLeft > targetFaces && !pq.empty()) {
+    Collapse c = pq.top();
+    pq.pop();
+    if (!vertAlive[c.v1] || !vertAlive[c.v2] || c.ver1 != version[c.v1] || c.ver2 != version[c.v2]) continue;
+    Eigen::Vector3d pos;
+    collapse_cost(Q[c.v1]+Q[c.v2], P.col(c.v1), P.col(c.v2), pos);
+    if (maxCost >= 0 && c.cost > maxCost*(W[c.v1]+W[c.v2])) break;
+
+    // faces on the edge disappear, the others around v1 and v2 must not flip
+    std::vector<int> shared;
+    bool valid = true;
+    for (int v: {c.v1, c.v2}) {
+      for (int f: vfaces[v]) {
+        if (!faceAlive[f]) continue;
+        int cnt = 0;
+        for (int k = 0; k < 3; k++) cnt += IDX(3*f+k) == c.v1 || IDX(3*f+k) == c.v2;
+        if (cnt == 2) {
+          if (v == c.v1) shared.push_back(f);
+          continue;
+        }
+        Eigen::Vector3d p[3], q[3];
+        for (int k = 0; k < 3; k++) {
+          int vid = IDX(3*f+k);
+          p[k] = P.col(vid);
+          q[k] = vid == v? pos : p[k];
+        }
+        Eigen::Vector3d n0 = (p[1]-p[0]).cross(p[2]-p[0]), n1 = (q[1]-q[0]).cross(q[2]-q[0]);
+        if (n0.dot(n1) <= 0.2*n0.norm()*n1.norm()) valid = false;
+      }
+    }
+    // link condition, the ends may only share the vertices of the faces on the edge
+    if (valid) {
+      std::vector<int> nebs1 = neighbours(c.v1), nebs2 = neighbours(c.v2), common;
+      std::set_intersection(nebs1.begin(), nebs1.end(), nebs2.begin(), nebs2.end(), std::back_inserter(common));
+      valid = common.size() == shared.size() && shared.size() > 0;
+    }
+    if (!valid) continue;
+
+    // merge v2 into v1
+    for (int f: shared) {
+      faceAlive[f] = false;
+      faceLeft--;
+    }
+    for (int f: vfaces[c.v2]) {
+      if (!faceAlive[f]) continue;
+      for (int k = 0; k < 3; k++) {
+        if (IDX(3*f+k) == c.v2) IDX(3*f+k) = c.v1;
+      }
+      vfaces[c.v1].push_back(f);
+    }
+    std::vector<int> alive;
+    for (int f: vfaces[c.v1]) {
+      if (faceAlive[f]) alive.push_back(f);
+    }
+    vfaces[c.v1] = alive;
+    vfaces[c.v2].clear();
+    vertAlive[c.v2] = false;
+    P.col(c.v1) = pos;
+    if (C.cols() == vnums && W[c.v1]+W[c.v2] > 0) C.col(c.v1) = (W[c.v1]*C.col(c.v1)+W[c.v2]*C.col(c.v2))/(W[c.v1]+W[c.v2]);
+    Q[c.v1] += Q[c.v2];
+    W[c.v1] += W[c.v2];
+    version[c.v1]++;
+    for (int v: neighbours(c.v1)) {
+      pq.push(make_collapse(std::min(c.v1, v), std::max(c.v1, v)));
+    }
+  }
+
+  // compact the vertexes and faces that are left
+  std::vector<int> newId(vnums, -1);
+  int vcnt = 0;
+  for (int f = 0; f < fnums; f++) {
+    if (!faceAlive[f]) continue;
+    for (int k = 0; k < 3; k++) {
+      if (newId[IDX(3*f+k)] < 0) newId[IDX(3*f+k)] = vcnt++;
+    }
+  }
+  V = Eigen::MatrixXd(4, vcnt);
+  for (int v = 0; v < vnums; v++) {
+    if (newId[v] >= 0) V.col(newId[v]) = Eigen::Vector4d(P(0, v), P(1, v), P(2, v), 1);
+  }
+  if (C.cols() == vnums) {
+    Eigen::MatrixXd newC(3, vcnt);
+    for (int v = 0; v < vnums; v++) {
+      if (newId[v] >= 0) newC.col(newId[v]) = C.col(v);
+    }
+    C = newC;
+  }
+  Eigen::VectorXi newIDX(3*faceLeft);
+  int fcnt = 0;
+  for (int f = 0; f < fnums; f++) {
+    if (!faceAlive[f]) continue;
+    for (int k = 0; k < 3; k++) newIDX(3*fcnt+k) = newId[IDX(3*f+k)];
+    fcnt++;
+  }
+  IDX = newIDX;
+  std::cout << "decimated to " << vcnt << " vertexes " << faceLeft << " faces" << std::endl;
+}
+
+// Vertex clustering, much coarser than decimate_mesh but linear in the mesh size. The vertexes
+// of every grid cell are merged into their mean, faces that collapse or repeat are dropped and so
+// are faces that would put a third face on an edge. Only used for quick previews.
+void cluster_mesh(Eigen::MatrixXd &V, Eigen::VectorXi &IDX, int targetFaces) {
+  int fnums = IDX.rows()/3;
+  if (fnums <= targetFaces) return;
+  Eigen::Vector3d minP = Eigen::Vector3d::Constant(DIST_MAX), maxP = Eigen::Vector3d::Constant(-DIST_MAX);
+  for (int i = 0; i < IDX.rows(); i++) {
+    minP = minP.cwiseMin(V.col(IDX(i)).head<3>());
+    maxP = maxP.cwiseMax(V.col(IDX(i)).head<3>());
+  }
+  // a surface crossing k^3 cells touches about k^2 of them, each giving two faces
+  int k = std::max(2, (int)sqrt(targetFaces/6.)+1);
+  double cellSize = (maxP-minP).maxCoeff()/k+ESP;
+
+  std::map<long long, int> cell2vert;
+  std::vector<int> vid2new(V.cols(), -1);
+  std::vector<Eigen::Vector3d> sum;
+  std::vector<int> cnt;
+  for (int i = 0; i < IDX.rows(); i++) {
+    int vid = IDX(i);
+    if (vid2new[vid] >= 0) continue;
+    Eigen::Vector3d cell = (V.col(vid).head<3>()-minP)/cellSize;
+    long long key = ((long long)floor(cell.x())*(k+1)+(long long)floor(cell.y()))*(k+1)+(long long)floor(cell.z());
+    auto it = cell2vert.find(key);
+    if (it == cell2vert.end()) {
+      it = cell2vert.insert(std::make_pair(key, (int)sum.size())).first;
+      sum.push_back(Eigen::Vector3d::Zero());
+      cnt.push_back(0);
+    }
+    vid2new[vid] = it->second;
+    sum[it->second] += V.col(vid).head<3>();
+    cnt[it->second]++;
+  }
+
+  std::set<std::vector<int>> seen;
+  std::map<std::pair<int, int>, int> edgeCnt;
+  std::vector<int> indices;
+  for (int f = 0; f < fnums; f++) {
+    int a = vid2new[IDX(3*f)], b = vid2new[IDX(3*f+1)], c = vid2new[IDX(3*f+2)];
+    if (a == b || b == c || a == c) continue;
+    std::vector<int> key = {a, b, c};
+    std::sort(key.begin(), key.end());
+    if (!seen.insert(key).second) continue;
+    std::pair<int, int> edges[3] = {std::make_pair(std::min(a, b), std::max(a, b)), std::make_pair(std::min(b, c), std::max(b, c)), std::make_pair(std::min(a, c), std::max(a, c))};
+    if (edgeCnt[edges[0]] >= 2 || edgeCnt[edges[1]] >= 2 || edgeCnt[edges[2]] >= 2) continue;
+    for (auto &edge: edges) edgeCnt[edge]++;
+    indices.push_back(a); indices.push_back(b); indices.push_back(c);
+  }
+
+  V = Eigen::MatrixXd(4, sum.size());
+  for (int i = 0; i < sum.size(); i++) {
+    V.col(i) = to_4_point(sum[i]/cnt[i]);
+  }
+  IDX.resize(indices.size());
+  for (int i = 0; i < indices.size(); i++) {
+    IDX(i) = indices[i];
+  }
+  std::cout << "clustered " << fnums << " faces into " << indices.size()/3 << std::endl;
+}
+
 Eigen::MatrixXd get_bounding_box(Eigen::MatrixXd V) {
   double maxx = -100, maxy = -100, maxz = -100;
   double minx = 100, miny = 100, minz = 100;
@@ -298,6 +645,1015 @@ Eigen::MatrixXd get_bounding_box_2d(Eigen::MatrixXd V) {
   return bounding_box;
 }
 
+// whether the convex polygons p and q overlap by more than a rounding error, polygons that only share an
+// edge or a corner do not. Separating axis test over the edge normals of both.
+bool convex_overlap_2d(const std::vector<Eigen::Vector2d> &p, const std::vector<Eigen::Vector2d> &q) {
+  Eigen::Vector2d lo = p[0], hi = p[0];
+  for (auto &v: p) { lo = lo.cwiseMin(v); hi = hi.cwiseMax(v); }
+  for (auto &v: q) { lo = lo.cwiseMin(v); hi = hi.cwiseMax(v); }
+  double tol = ESP*(hi-lo).norm();
+  for (int s = 0; s < 2; s++) {
+    const std::vector<Eigen::Vector2d> &a = s == 0? p : q, &b = s == 0? q : p;
+    for (int i = 0; i < a.size(); i++) {
+      Eigen::Vector2d edge = a[(i+1)%a.size()]-a[i];
+      if (edge.norm() < tol) continue;
+      Eigen::Vector2d normal = Eigen::Vector2d(-edge.y(), edge.x()).normalized();
+      double aMin = normal.dot(a[0]), aMax = aMin, bMin = normal.dot(b[0]), bMax = bMin;
+      for (auto &v: a) { aMin = fmin(aMin, normal.dot(v)); aMax = fmax(aMax, normal.dot(v)); }
+      for (auto &v: b) { bMin = fmin(bMin, normal.dot(v)); bMax = fmax(bMax, normal.dot(v)); }
+      if (aMax <= bMin+tol || bMax <= aMin+tol) return false;
+    }
+  }
+  return true;
+}
+
+// convex hull of the x, y of the columns of P, counter clockwise (monotone chain)
+std::vector<Eigen::Vector2d> convex_hull_2d(const Eigen::MatrixXd &P) {
+  std::vector<Eigen::Vector2d> points(P.cols());
+  for (int i = 0; i < P.cols(); i++) points[i] = Eigen::Vector2d(P(0, i), P(1, i));
+  std::sort(points.begin(), points.end(), [](const Eigen::Vector2d &a, const Eigen::Vector2d &b) {
+    return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+  });
+  if (points.size() < 3) return points;
+  auto cross = [](const Eigen::Vector2d &o, const Eigen::Vector2d &a, const Eigen::Vector2d &b) {
+    return (a.x()-o.x())*(b.y()-o.y())-(a.y()-o.y())*(b.x()-o.x());
+  };
+  std::vector<Eigen::Vector2d> hull(2*points.size());
+  int k = 0;
+  for (int i = 0; i < points.size(); i++) {
+    while (k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0) k--;
+    hull[k++] = points[i];
+  }
+  for (int i = points.size()-2, t = k+1; i >= 0; i--) {
+    while (k >= t && cross(hull[k-2], hull[k-1], points[i]) <= 0) k--;
+    hull[k++] = points[i];
+  }
+  hull.resize(k-1);
+  return hull;
+}
+
+// Rotating calipers over a counter clockwise hull. The minimum area rectangle has a side on a hull
+// edge; for every edge the farthest points along the edge, against it and away from it are walked
+// forward, so all edges take O(h). Returns the angle to rotate by so the rectangle becomes axis
+// aligned and at least as wide as it is high.
+double min_area_rect_angle(const std::vector<Eigen::Vector2d> &hull) {
+  int n = hull.size();
+  if (n < 3) return n == 2? -atan2(hull[1].y()-hull[0].y(), hull[1].x()-hull[0].x()) : 0.;
+  double bestArea = -1., bestAngle = 0.;
+  int right = 1, top = 1, left = 1;
+  for (int i = 0; i < n; i++) {
+    Eigen::Vector2d a = hull[i], u = (hull[(i+1)%n]-a).normalized();
+    Eigen::Vector2d v(-u.y(), u.x());
+    while ((hull[(right+1)%n]-a).dot(u) > (hull[right]-a).dot(u)+ESP*ESP) right = (right+1)%n;
+    if (i == 0) top = right;
+    while ((hull[(top+1)%n]-a).dot(v) > (hull[top]-a).dot(v)+ESP*ESP) top = (top+1)%n;
+    if (i == 0) left = top;
+    while ((hull[(left+1)%n]-a).dot(u) < (hull[left]-a).dot(u)-ESP*ESP) left = (left+1)%n;
+    double w = (hull[right]-a).dot(u)-(hull[left]-a).dot(u), h = (hull[top]-a).dot(v);
+    if (bestArea < 0 || w*h < bestArea) {
+      bestArea = w*h;
+      double angle = -atan2(u.y(), u.x());
+      bestAngle = w >= h? angle : angle+PI/2.;
+    }
+  }
+  return bestAngle;
+}
+
+// Lowest free height of every x span of a paper paperW wide, the paper grows downwards
+struct Skyline {
+  struct Span { double x, y, w; };
+  std::vector<Span> spans;
+  double paperW;
+
+  explicit Skyline(double paperW): spans(1, Span{0., 0., paperW}), paperW(paperW) {}
+
+  // The spot for a w x h rectangle where its bottom stays highest and not below maxH, ties go to the spot
+  // wasting less area below it, then to the left. Returns false when there is none.
+  bool find(double w, double h, double maxH, double &bestX, double &bestY) const {
+    int bestSpan = -1;
+    double bestWaste = 0.;
+    for (int j = 0; j < spans.size(); j++) {
+      if (spans[j].x+w > paperW+ESP) break;
+      // the rectangle rests on the highest span it covers
+      double y = 0., waste = 0., right = spans[j].x+w;
+      for (int k = j; k < spans.size() && spans[k].x < right-ESP; k++) {
+        y = fmax(y, spans[k].y);
+      }
+      // the waste only matters for a tie
+      if (y+h > maxH+ESP || (bestSpan >= 0 && y > bestY+ESP)) continue;
+      for (int k = j; k < spans.size() && spans[k].x < right-ESP; k++) {
+        waste += (y-spans[k].y)*(fmin(right, spans[k].x+spans[k].w)-spans[k].x);
+      }
+      if (bestSpan < 0 || y+h < bestY+h-ESP || (fabs(y-bestY) < ESP && waste < bestWaste)) {
+        bestSpan = j;
+        bestY = y;
+        bestWaste = waste;
+      }
+    }
+    if (bestSpan < 0) return false;
+    bestX = spans[bestSpan].x;
+    return true;
+  }
+
+  // raise the spans covered by a w x h rectangle at (x, y) to its bottom
+  void place(double x, double y, double w, double h) {
+    std::vector<Span> next;
+    for (int k = 0; k < spans.size(); k++) {
+      Span span = spans[k];
+      double spanR = span.x+span.w;
+      if (spanR <= x+ESP || span.x >= x+w-ESP) {
+        next.push_back(span);
+        continue;
+      }
+      if (span.x < x) next.push_back({span.x, span.y, x-span.x});
+      if (next.empty() || next.back().x+next.back().w < x+ESP) next.push_back({x, y+h, w});
+      if (spanR > x+w) next.push_back({x+w, span.y, spanR-x-w});
+    }
+    // merge neighbour spans at the same height
+    spans.clear();
+    for (Span &span: next) {
+      if (!spans.empty() && fabs(spans.back().y-span.y) < ESP) spans.back().w += span.w;
+      else spans.push_back(span);
+    }
+  }
+
+  double lowest() const {
+    double y = DIST_MAX;
+    for (const Span &span: spans) y = fmin(y, span.y);
+    return y;
+  }
+};
+
+// indexes of sizes by decreasing height
+static std::vector<int> by_height(const std::vector<Eigen::Vector2d> &sizes) {
+  std::vector<int> order(sizes.size());
+  for (int i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return sizes[a].y() > sizes[b].y();
+  });
+  return order;
+}
+
+// Skyline packing with best fit. The paper is paperW wide and grows downwards, the skyline keeps
+// the lowest free height of every x span. Rectangles go in by decreasing height, each one takes the
+// span where its bottom stays highest (ties go to the span wasting less area below it, then left).
+// Returns the top left corner of every rectangle as distances from the top left of the paper.
+std::vector<Eigen::Vector2d> pack_skyline(const std::vector<Eigen::Vector2d> &sizes, double paperW, double &paperH) {
+  Skyline skyline(paperW);
+  std::vector<Eigen::Vector2d> corners(sizes.size());
+  paperH = 0.;
+  for (int i: by_height(sizes)) {
+    double w = fmin(sizes[i].x(), paperW), h = sizes[i].y(), x, y;
+    skyline.find(w, h, DIST_MAX, x, y);
+    corners[i] = Eigen::Vector2d(x, y);
+    paperH = fmax(paperH, y+h);
+    skyline.place(x, y, w, h);
+  }
+  return corners;
+}
+
+// One pass of the skyline packer over pages of pageW x pageH. The boxes go in by decreasing height, each
+// one to the first open page with room for it, and a new page is opened when none has. At most
+// PAGE_OPEN_LIMIT pages stay open, the oldest one is closed for good when another is needed, and a page is
+// closed as soon as its lowest span has no room left for the smallest box. A box taller than a page gets a
+// page of its own. Returns the page and the top left corner on it of every box. Stops as soon as more than
+// maxPages pages are used.
+static std::vector<Eigen::Vector3d> paginate_up_to(const std::vector<Eigen::Vector2d> &sizes, double pageW, double pageH, int maxPages, int &pageCnt)
+{
+  std::vector<Eigen::Vector3d> placements(sizes.size());
+  std::vector<int> order = by_height(sizes);
+  double smallest = order.empty()? 0. : sizes[order.back()].y();
+  // the open pages and their numbers
+  std::vector<Skyline> open;
+  std::vector<int> openIds;
+  pageCnt = 0;
+  for (int i: order) {
+    double w = fmin(sizes[i].x(), pageW), h = sizes[i].y(), x = 0., y = 0.;
+    if (h > pageH+ESP) {
+      placements[i] = Eigen::Vector3d(0., 0., pageCnt++);
+      if (pageCnt > maxPages) break;
+      continue;
+    }
+    int p = 0;
+    while (p < open.size() && !open[p].find(w, h, pageH, x, y)) p++;
+    if (p == open.size()) {
+      if (open.size() == PAGE_OPEN_LIMIT) {
+        open.erase(open.begin());
+        openIds.erase(openIds.begin());
+        p--;
+      }
+      open.push_back(Skyline(pageW));
+      openIds.push_back(pageCnt++);
+      open[p].find(w, h, pageH, x, y);
+    }
+    if (pageCnt > maxPages) break;
+    placements[i] = Eigen::Vector3d(x, y, openIds[p]);
+    open[p].place(x, y, w, h);
+    if (open[p].lowest()+smallest > pageH+ESP) {
+      open.erase(open.begin()+p);
+      openIds.erase(openIds.begin()+p);
+    }
+  }
+  return placements;
+}
+
+std::vector<Eigen::Vector3d> paginate_boxes(const std::vector<Eigen::Vector2d> &sizes, double pageW, double pageH, int &pageCnt)
+{
+  return paginate_up_to(sizes, pageW, pageH, INT_MAX, pageCnt);
+}
+
+double fit_page_scale(const std::vector<Eigen::Vector2d> &sizes, double margin, Eigen::Vector2d page, int pageBudget)
+{
+  // the boxes and their margins scale with the model, the printable area of a page does not
+  auto fits = [&](double scale) {
+    std::vector<Eigen::Vector2d> scaled;
+    for (auto size: sizes) {
+      if ((size.x()-margin)*scale > page.x()+ESP || (size.y()-margin)*scale > page.y()+ESP) return false;
+      scaled.push_back(size*scale);
+    }
+    // a probe gives up as soon as it needs more pages than the budget
+    int pageCnt;
+    paginate_up_to(scaled, page.x()+margin*scale, page.y()+margin*scale, pageBudget, pageCnt);
+    return pageCnt <= pageBudget;
+  };
+  // no scale fits above the one where the islands alone cover the pages or the largest one covers a page
+  double area = 0., hi = DIST_MAX;
+  for (auto size: sizes) {
+    double w = fmax(size.x()-margin, ESP), h = fmax(size.y()-margin, ESP);
+    area += w*h;
+    hi = fmin(hi, fmin(page.x()/w, page.y()/h));
+  }
+  hi = fmin(hi, sqrt(pageBudget*page.x()*page.y()/fmax(area, ESP)));
+
+  // every round probes evenly spaced scales in parallel and keeps the gap above the largest one that fits
+  int probes = std::max(1u, std::thread::hardware_concurrency());
+  double lo = 0.;
+  while (hi-lo > PAGE_SCALE_TOLERANCE*hi) {
+    double step = (hi-lo)/(probes+1);
+    std::vector<char> fit(probes);
+    parallel_for(probes, [&](int k) {
+      fit[k] = fits(lo+step*(k+1));
+    });
+    int k = probes-1;
+    while (k >= 0 && !fit[k]) k--;
+    lo += step*(k+1);
+    hi = lo+step;
+  }
+  return lo;
+}
+
+TextWriter::TextWriter(std::ostream &out, int precision) : TextWriter(out, precision, TEXT_BUFFER_SIZE)
+{
+}
+
+TextWriter::TextWriter(std::ostream &out, int precision, int bufferSize) : out(out), precision(precision), used(0)
+{
+  unit = 1;
+  for (int i = 0; i < precision; i++) unit *= 10;
+  buffer.resize(bufferSize);
+}
+
+TextWriter::~TextWriter()
+{
+  flush();
+}
+
+void TextWriter::flush()
+{
+  out.write(buffer.data(), used);
+  used = 0;
+}
+
+void TextWriter::write(const char *str, int len)
+{
+  if (used+len > buffer.size()) flush();
+  if (len > buffer.size()) {
+    out.write(str, len);
+    return;
+  }
+  memcpy(buffer.data()+used, str, len);
+  used += len;
+}
+
+TextWriter& TextWriter::operator<<(const char *str)
+{
+  write(str, strlen(str));
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(const std::string &str)
+{
+  write(str.data(), str.size());
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(char c)
+{
+  write(&c, 1);
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(double value)
+{
+  char digits[32];
+  int len = 0;
+  if (!(fabs(value) < 1e15/unit)) {
+    // out of the range of the fixed point, nan and inf
+    len = snprintf(digits, sizeof(digits), "%g", value);
+    write(digits, len);
+    return *this;
+  }
+  // fixed point digits from the last decimal up, the trailing zeros of the decimals are dropped
+  long long n = llround(value*unit);
+  bool negative = n < 0;
+  if (negative) n = -n;
+  char reversed[32];
+  int cnt = 0, decimals = precision;
+  while (decimals > 0 && n%10 == 0) {
+    n /= 10;
+    decimals--;
+  }
+  for (int i = 0; i < decimals; i++) {
+    reversed[cnt++] = '0'+n%10;
+    n /= 10;
+  }
+  if (decimals > 0) reversed[cnt++] = '.';
+  do {
+    reversed[cnt++] = '0'+n%10;
+    n /= 10;
+  } while (n > 0);
+  if (negative) digits[len++] = '-';
+  while (cnt > 0) digits[len++] = reversed[--cnt];
+  write(digits, len);
+  return *this;
+}
+
+SvgWriter::SvgWriter(std::ostream &out, int precision) : TextWriter(out, precision)
+{
+}
+
+SvgWriter::SvgWriter(std::ostream &out, int precision, int bufferSize) : TextWriter(out, precision, bufferSize)
+{
+}
+
+void SvgWriter::outline(const std::vector<std::vector<Eigen::Vector2d>> &loops)
+{
+  *this << "<path d='";
+  for (auto &loop: loops) {
+    for (int i = 0; i < loop.size(); i++) {
+      *this << (i == 0? "M" : " L") << loop[i].x() << ',' << loop[i].y();
+    }
+    *this << " Z ";
+  }
+  *this << "' fill-rule='evenodd' fill='rgb(255, 255, 255)' stroke='black'/>\n";
+}
+
+void SvgWriter::folds(const std::vector<Eigen::Vector2d> &segments, const char *style)
+{
+  if (segments.empty()) return;
+  *this << "<path class='" << style << "' d='";
+  for (int i = 0; i < segments.size(); i += 2) {
+    *this << 'M' << segments[i].x() << ',' << segments[i].y() << " L" << segments[i+1].x() << ',' << segments[i+1].y() << ' ';
+  }
+  *this << "' fill='none' stroke='black'/>\n";
+}
+
+void SvgWriter::labels(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector2d> &inward, const std::vector<int> &numbers)
+{
+  if (numbers.empty()) return;
+  *this << "<g class='glue'>\n";
+  for (int i = 0; i < numbers.size(); i++) {
+    Eigen::Vector2d at = points[i]+inward[i]*GLUE_LABEL_OFFSET;
+    *this << "<text x='" << at.x() << "' y='" << at.y() << "'>" << std::to_string(numbers[i]) << "</text>\n";
+  }
+  *this << "</g>\n";
+}
+
+PdfContent::PdfContent(std::ostream &out, int precision, int bufferSize) : TextWriter(out, precision, bufferSize)
+{
+}
+
+void PdfContent::outline(const std::vector<std::vector<Eigen::Vector2d>> &loops)
+{
+  for (auto &loop: loops) {
+    for (int i = 0; i < loop.size(); i++) {
+      *this << loop[i].x() << ' ' << loop[i].y() << (i == 0? " m\n" : " l\n");
+    }
+    *this << "h\n";
+  }
+  *this << "B*\n";
+}
+
+void PdfContent::folds(const std::vector<Eigen::Vector2d> &segments, const char *style)
+{
+  if (segments.empty()) return;
+  // the dashes of the svg styles in points
+  *this << (strcmp(style, "mountain") == 0? "[11.34 3.4 2.27 3.4] 0 d\n" : "[6.8 4.54] 0 d\n");
+  for (int i = 0; i < segments.size(); i += 2) {
+    *this << segments[i].x() << ' ' << segments[i].y() << " m " << segments[i+1].x() << ' ' << segments[i+1].y() << " l\n";
+  }
+  *this << "S\n[] 0 d\n";
+}
+
+void PdfContent::labels(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector2d> &inward, const std::vector<int> &numbers)
+{
+  if (numbers.empty()) return;
+  // black Helvetica, centred by the widths of its digits of 0.556 em and half of its cap height
+  double size = GLUE_LABEL_SIZE*PDF_POINTS_PER_MM;
+  *this << "q 0 g BT /F1 " << size << " Tf\n";
+  for (int i = 0; i < numbers.size(); i++) {
+    std::string digits = std::to_string(numbers[i]);
+    Eigen::Vector2d at = points[i]+inward[i]*GLUE_LABEL_OFFSET*PDF_POINTS_PER_MM;
+    *this << "1 0 0 1 " << at.x()-digits.size()*0.278*size << ' ' << at.y()-0.359*size << " Tm (" << digits << ") Tj\n";
+  }
+  *this << "ET Q\n";
+}
+
+PdfBakedContent::PdfBakedContent(std::ostream &out, int precision, int bufferSize) : PdfContent(out, precision, bufferSize)
+{
+}
+
+void PdfBakedContent::outline(const std::vector<std::vector<Eigen::Vector2d>> &loops)
+{
+  for (auto &loop: loops) {
+    for (int i = 0; i < loop.size(); i++) {
+      *this << loop[i].x() << ' ' << loop[i].y() << (i == 0? " m\n" : " l\n");
+    }
+    *this << "h\n";
+  }
+  *this << "S\n";
+}
+
+PdfWriter::PdfWriter(std::string path) : pos(0), contentId(-1), imageId(-1)
+{
+  file.open(path, std::ios::binary);
+  // object 0 is the head of the free list, 1 the catalog and 2 the page tree
+  offsets.assign(3, 0);
+  write("%PDF-1.4\n%\xe2\xe3\xcf\xd3\n");
+  // the font of the glue labels, shared by all pages
+  fontId = newObject();
+  beginObject(fontId);
+  write("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n");
+}
+
+PdfWriter::~PdfWriter()
+{
+  close();
+}
+
+int PdfWriter::newObject()
+{
+  offsets.push_back(0);
+  return offsets.size()-1;
+}
+
+void PdfWriter::beginObject(int id)
+{
+  offsets[id] = pos;
+  write(std::to_string(id)+" 0 obj\n");
+}
+
+void PdfWriter::write(const std::string &str)
+{
+  file.write(str.data(), str.size());
+  pos += str.size();
+}
+
+void PdfWriter::beginPage(double width, double height)
+{
+  pageWidth = width;
+  pageHeight = height;
+  // the length of the stream is only known at its end, so it is an object of its own
+  contentId = newObject();
+  lengthId = newObject();
+  beginObject(contentId);
+  write("<< /Length "+std::to_string(lengthId)+" 0 R >>\nstream\n");
+  streamStart = pos;
+  if (imageId >= 0) {
+    std::ostringstream place;
+    place << "q " << width << " 0 0 " << height << " 0 0 cm /Im1 Do Q\n";
+    write(place.str());
+  }
+  // white fill, black strokes of 0.2 mm with round joins
+  write("1 g 0 G 0.567 w 1 j\n");
+}
+
+void PdfWriter::pageImage(int width, int height, const std::vector<unsigned char> &rgb)
+{
+  // run length encoded, which mostly packs the white between the islands. A byte n < 128 is followed by
+  // n+1 bytes to copy, a byte n > 128 by one byte to repeat 257-n times.
+  std::string data;
+  for (int i = 0; i < rgb.size();) {
+    int run = 1;
+    while (i+run < rgb.size() && run < 128 && rgb[i+run] == rgb[i]) run++;
+    if (run > 1) {
+      data += (char)(257-run);
+      data += (char)rgb[i];
+      i += run;
+      continue;
+    }
+    int literal = 1;
+    while (i+literal < rgb.size() && literal < 128 && (i+literal+1 == rgb.size() || rgb[i+literal] != rgb[i+literal+1])) literal++;
+    data += (char)(literal-1);
+    data.append((const char*)&rgb[i], literal);
+    i += literal;
+  }
+  data += (char)128;
+  imageId = newObject();
+  beginObject(imageId);
+  write("<< /Type /XObject /Subtype /Image /Width "+std::to_string(width)+" /Height "+std::to_string(height)+" /ColorSpace /DeviceRGB /BitsPerComponent 8 /Filter /RunLengthDecode /Length "+std::to_string(data.size())+" >>\nstream\n");
+  write(data);
+  write("\nendstream\nendobj\n");
+}
+
+PdfWriter& PdfWriter::operator<<(const std::string &content)
+{
+  write(content);
+  return *this;
+}
+
+void PdfWriter::endPage()
+{
+  long long length = pos-streamStart;
+  write("endstream\nendobj\n");
+  beginObject(lengthId);
+  write(std::to_string(length)+"\nendobj\n");
+  int pageId = newObject();
+  beginObject(pageId);
+  std::ostringstream box;
+  box << pageWidth << ' ' << pageHeight;
+  std::string image = imageId >= 0? " /XObject << /Im1 "+std::to_string(imageId)+" 0 R >>" : "";
+  write("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 "+box.str()+"] /Resources << /Font << /F1 "+std::to_string(fontId)+" 0 R >>"+image+" >> /Contents "+std::to_string(contentId)+" 0 R >>\nendobj\n");
+  pages.push_back(pageId);
+  contentId = -1;
+  imageId = -1;
+}
+
+void PdfWriter::close()
+{
+  if (!file.is_open()) return;
+  if (contentId >= 0) endPage();
+  beginObject(2);
+  write("<< /Type /Pages /Kids [");
+  for (int id: pages) {
+    write(std::to_string(id)+" 0 R ");
+  }
+  write("] /Count "+std::to_string(pages.size())+" >>\nendobj\n");
+  beginObject(1);
+  write("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+  // every xref entry is exactly 20 bytes
+  long long xref = pos;
+  write("xref\n0 "+std::to_string(offsets.size())+"\n0000000000 65535 f \n");
+  char entry[21];
+  for (int id = 1; id < offsets.size(); id++) {
+    snprintf(entry, sizeof(entry), "%010lld 00000 n \n", offsets[id]);
+    write(entry);
+  }
+  write("trailer\n<< /Size "+std::to_string(offsets.size())+" /Root 1 0 R >>\nstartxref\n"+std::to_string(xref)+"\n%%EOF\n");
+  file.close();
+}
+
+void CutPaths::outline(const std::vector<std::vector<Eigen::Vector2d>> &loops)
+{
+  cuts.insert(cuts.end(), loops.begin(), loops.end());
+}
+
+void CutPaths::folds(const std::vector<Eigen::Vector2d> &segments, const char *style)
+{
+  std::vector<std::vector<Eigen::Vector2d>> &scores = strcmp(style, "mountain") == 0? mountains : valleys;
+  for (int i = 0; i < segments.size(); i += 2) {
+    scores.push_back(std::vector<Eigen::Vector2d>(segments.begin()+i, segments.begin()+i+2));
+  }
+}
+
+void CutPaths::append(const CutPaths &paths)
+{
+  cuts.insert(cuts.end(), paths.cuts.begin(), paths.cuts.end());
+  valleys.insert(valleys.end(), paths.valleys.begin(), paths.valleys.end());
+  mountains.insert(mountains.end(), paths.mountains.begin(), paths.mountains.end());
+}
+
+OccupancyBitmap::OccupancyBitmap(int w, int h) : w(w), h(h)
+{
+  words = (w+63)/64;
+  bits.assign(words*h, 0);
+}
+
+bool OccupancyBitmap::get(int x, int y) const
+{
+  return (bits[y*words+x/64] >> (x%64)) & 1;
+}
+
+void OccupancyBitmap::set(int x, int y)
+{
+  bits[y*words+x/64] |= uint64_t(1) << (x%64);
+}
+
+void OccupancyBitmap::fillTriangle(Eigen::Vector2d a, Eigen::Vector2d b, Eigen::Vector2d c)
+{
+  Eigen::Vector2d P[3] = {a, b, c};
+  double minY = fmin(a.y(), fmin(b.y(), c.y())), maxY = fmax(a.y(), fmax(b.y(), c.y()));
+  for (int row = std::max(0, (int)floor(minY)); row <= std::min(h-1, (int)floor(maxY)); row++) {
+    // x extent of the triangle inside the band [row, row+1]
+    double minX = DIST_MAX, maxX = -DIST_MAX;
+    for (int k = 0; k < 3; k++) {
+      Eigen::Vector2d p = P[k], q = P[(k+1)%3];
+      if (p.y() >= row && p.y() <= row+1) {
+        minX = fmin(minX, p.x());
+        maxX = fmax(maxX, p.x());
+      }
+      for (double bandY: {(double)row, row+1.}) {
+        if ((p.y()-bandY)*(q.y()-bandY) < 0) {
+          double x = p.x()+(q.x()-p.x())*(bandY-p.y())/(q.y()-p.y());
+          minX = fmin(minX, x);
+          maxX = fmax(maxX, x);
+        }
+      }
+    }
+    for (int x = std::max(0, (int)floor(minX)); x <= std::min(w-1, (int)floor(maxX)); x++) {
+      set(x, row);
+    }
+  }
+}
+
+void OccupancyBitmap::dilate(int r)
+{
+  OccupancyBitmap out(w+2*r, h+2*r);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      if (!get(x, y)) continue;
+      for (int dy = 0; dy <= 2*r; dy++) {
+        for (int dx = 0; dx <= 2*r; dx++) out.set(x+dx, y+dy);
+      }
+    }
+  }
+  *this = out;
+}
+
+int OccupancyBitmap::count() const
+{
+  int cnt = 0;
+  for (uint64_t word: bits) cnt += __builtin_popcountll(word);
+  return cnt;
+}
+
+// out bit k = in bit k+s
+static void shift_down(const std::vector<uint64_t> &in, int s, std::vector<uint64_t> &out)
+{
+  int ws = s/64, bs = s%64, n = in.size();
+  for (int i = 0; i < n; i++) {
+    uint64_t lo = i+ws < n? in[i+ws] : 0, hi = i+ws+1 < n? in[i+ws+1] : 0;
+    out[i] = bs == 0? lo : (lo >> bs) | (hi << (64-bs));
+  }
+}
+
+void OccupancyBitmap::freePositions(const OccupancyBitmap &mask, int y, std::vector<uint64_t> &free) const
+{
+  free.assign(words, ~uint64_t(0));
+  // positions that keep the mask inside the paper
+  for (int x = std::max(0, w-mask.w+1); x < words*64; x++) free[x/64] &= ~(uint64_t(1) << (x%64));
+  if (w < mask.w) return;
+
+  std::vector<uint64_t> run(words), tmp(words);
+  for (int i = 0; i < mask.h; i++) {
+    int row = y+i;
+    if (row >= h) break;
+    for (int a = 0; a < mask.w; a++) {
+      if (!mask.get(a, i)) continue;
+      int b = a;
+      while (b+1 < mask.w && mask.get(b+1, i)) b++;
+      // bit k of run: the cells k .. k+len-1 of the row are all free, doubled up to the run length
+      for (int k = 0; k < words; k++) run[k] = ~bits[row*words+k];
+      if (w%64) run[words-1] &= (uint64_t(1) << (w%64))-1;
+      int len = 1, need = b-a+1;
+      while (len < need) {
+        int step = std::min(len, need-len);
+        shift_down(run, step, tmp);
+        for (int k = 0; k < words; k++) run[k] &= tmp[k];
+        len += step;
+      }
+      shift_down(run, a, tmp);
+      bool any = false;
+      for (int k = 0; k < words; k++) {
+        free[k] &= tmp[k];
+        any |= free[k] != 0;
+      }
+      if (!any) return;
+      a = b;
+    }
+  }
+}
+
+void OccupancyBitmap::place(const OccupancyBitmap &mask, int x, int y)
+{
+  if (y+mask.h > h) {
+    h = y+mask.h;
+    bits.resize(words*h, 0);
+  }
+  for (int i = 0; i < mask.h; i++) {
+    for (int j = 0; j < mask.w; j++) {
+      if (mask.get(j, i)) set(x+j, y+i);
+    }
+  }
+}
+
+// Greedy top left nesting on a paper paperW cells wide. masks[i] holds the bitmaps of island i in
+// a few orientations; the islands go in by decreasing area and each takes the orientation and spot
+// nearest to the top, then to the left. Returns (x, y, orientation) of every island.
+std::vector<Eigen::Vector3i> nest_bitmaps(const std::vector<std::vector<OccupancyBitmap>> &masks, int paperW, int &paperH)
+{
+  std::vector<int> order(masks.size());
+  std::vector<int> area(masks.size());
+  for (int i = 0; i < masks.size(); i++) {
+    order[i] = i;
+    area[i] = masks[i][0].count();
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return area[a] > area[b];
+  });
+
+  OccupancyBitmap paper(paperW, 0);
+  std::vector<Eigen::Vector3i> placements(masks.size());
+  std::vector<uint64_t> free;
+  int firstOpen = 0;
+  for (int i: order) {
+    int bestX = -1, bestY = 0, bestR = 0;
+    for (int r = 0; r < masks[i].size(); r++) {
+      const OccupancyBitmap &mask = masks[i][r];
+      if (mask.w > paperW) continue;
+      for (int y = firstOpen; bestX < 0 || y <= bestY; y++) {
+        paper.freePositions(mask, y, free);
+        int x = -1;
+        for (int k = 0; k < free.size() && x < 0; k++) {
+          if (free[k]) x = 64*k+__builtin_ctzll(free[k]);
+        }
+        if (x < 0) continue;
+        if (bestX < 0 || y < bestY || (y == bestY && x < bestX)) {
+          bestX = x;
+          bestY = y;
+          bestR = r;
+        }
+        break;
+      }
+    }
+    paper.place(masks[i][bestR], bestX, bestY);
+    placements[i] = Eigen::Vector3i(bestX, bestY, bestR);
+    // skip the rows that are full by now
+    while (firstOpen < paper.h) {
+      bool full = true;
+      for (int x = 0; x < paperW && full; x++) full = paper.get(x, firstOpen);
+      if (!full) break;
+      firstOpen++;
+    }
+  }
+  paperH = paper.h;
+  return placements;
+}
+
+// Order the paths to cut them with little pen-up travel, starting at pen. A greedy tour goes to the nearest
+// free entry point found in a grid over the entry points: either end of an open path or any vertex of a
+// loop, which is rotated to start there. The tour is then improved by 2-opt moves reversing runs of up to
+// TOUR_2OPT_WINDOW paths. The pen ends where the last path ends, returns the pen-up travel of the tour.
+double order_paths(std::vector<std::vector<Eigen::Vector2d>> &paths, bool closed, Eigen::Vector2d &pen)
+{
+  int n = paths.size();
+  if (n == 0) return 0.;
+
+  // entry points in a grid of about one point per cell
+  std::vector<Eigen::Vector2d> entries;
+  std::vector<int> entryPath, entryVertex;
+  Eigen::Vector2d lo = pen, hi = pen;
+  for (int i = 0; i < n; i++) {
+    int last = paths[i].size()-1;
+    for (int k = 0; k <= last; k++) {
+      if (!closed && k != 0 && k != last) continue;
+      entries.push_back(paths[i][k]);
+      entryPath.push_back(i);
+      entryVertex.push_back(k);
+      lo = lo.cwiseMin(paths[i][k]);
+      hi = hi.cwiseMax(paths[i][k]);
+    }
+  }
+  double cell = std::max(sqrt((hi-lo).prod()/entries.size()), std::max((hi-lo).maxCoeff()/4096., ESP));
+  int gw = int((hi.x()-lo.x())/cell)+1, gh = int((hi.y()-lo.y())/cell)+1;
+  std::vector<std::vector<int>> grid(gw*gh);
+  auto cellOf = [&](const Eigen::Vector2d &p) {
+    return Eigen::Vector2i(std::min(gw-1, int((p.x()-lo.x())/cell)), std::min(gh-1, int((p.y()-lo.y())/cell)));
+  };
+  for (int e = 0; e < entries.size(); e++) {
+    Eigen::Vector2i c = cellOf(entries[e]);
+    grid[c.y()*gw+c.x()].push_back(e);
+  }
+
+  // greedy tour, the entries of used paths are dropped from the cells as they are met
+  std::vector<bool> used(n, false);
+  std::vector<std::vector<Eigen::Vector2d>> tour;
+  tour.reserve(n);
+  Eigen::Vector2d start = pen;
+  double greedy = 0.;
+  for (int step = 0; step < n; step++) {
+    Eigen::Vector2i c = cellOf(pen);
+    int best = -1;
+    double bestDist = 0.;
+    for (int r = 0; r <= std::max(gw, gh); r++) {
+      for (int y = c.y()-r; y <= c.y()+r; y++) {
+        if (y < 0 || y >= gh) continue;
+        // the cells of ring r only
+        int dx = (y == c.y()-r || y == c.y()+r)? 1 : 2*r;
+        for (int x = c.x()-r; x <= c.x()+r; x += std::max(dx, 1)) {
+          if (x < 0 || x >= gw) continue;
+          std::vector<int> &bucket = grid[y*gw+x];
+          for (int i = 0; i < bucket.size(); ) {
+            int e = bucket[i];
+            if (used[entryPath[e]]) {
+              bucket[i] = bucket.back();
+              bucket.pop_back();
+              continue;
+            }
+            double d = (entries[e]-pen).squaredNorm();
+            if (best < 0 || d < bestDist) {
+              bestDist = d;
+              best = e;
+            }
+            i++;
+          }
+        }
+      }
+      // the cells beyond ring r are at least r cells away
+      if (best >= 0 && sqrt(bestDist) <= r*cell) break;
+    }
+    int i = entryPath[best], k = entryVertex[best];
+    used[i] = true;
+    tour.push_back(paths[i]);
+    if (closed)
+      std::rotate(tour.back().begin(), tour.back().begin()+k, tour.back().end());
+    else if (k != 0)
+      std::reverse(tour.back().begin(), tour.back().end());
+    greedy += sqrt(bestDist);
+    pen = closed? tour.back().front() : tour.back().back();
+  }
+  paths.swap(tour);
+
+  // 2-opt: reversing the paths i..j joins the end of i-1 to the end of j and the start of i to the start
+  // of j+1. A loop starts and ends on the same vertex, so it keeps its direction.
+  auto head = [&](int i) -> const Eigen::Vector2d& { return paths[i].front(); };
+  auto tail = [&](int i) -> const Eigen::Vector2d& { return closed? paths[i].front() : paths[i].back(); };
+  for (int pass = 0; pass < TOUR_2OPT_PASSES; pass++) {
+    bool improved = false;
+    for (int i = 0; i < n; i++) {
+      Eigen::Vector2d prev = i == 0? start : tail(i-1);
+      for (int j = i+1; j < std::min(n, i+1+TOUR_2OPT_WINDOW); j++) {
+        double delta = (prev-tail(j)).norm()-(prev-head(i)).norm();
+        if (j+1 < n) delta += (head(i)-head(j+1)).norm()-(tail(j)-head(j+1)).norm();
+        if (delta < -ESP) {
+          std::reverse(paths.begin()+i, paths.begin()+j+1);
+          if (!closed) {
+            for (int k = i; k <= j; k++) {
+              std::reverse(paths[k].begin(), paths[k].end());
+            }
+          }
+          improved = true;
+        }
+      }
+    }
+    if (!improved) break;
+  }
+
+  // open paths that meet end to start are joined, the pen stays down between them
+  if (!closed) {
+    int joined = 0;
+    for (int i = 1; i < n; i++) {
+      if ((paths[i].front()-paths[joined].back()).norm() < ESP)
+        paths[joined].insert(paths[joined].end(), paths[i].begin()+1, paths[i].end());
+      else
+        paths[++joined].swap(paths[i]);
+    }
+    paths.resize(joined+1);
+  }
+
+  double travel = 0.;
+  pen = start;
+  for (int i = 0; i < paths.size(); i++) {
+    travel += (head(i)-pen).norm();
+    pen = tail(i);
+  }
+  std::cout << n << " paths in " << paths.size() << " strokes, pen-up travel " << greedy << "mm greedy, " << travel << "mm after 2-opt" << std::endl;
+  return travel;
+}
+
+// polylines of one layer of an R12 dxf, closed when flag is 1
+static void write_dxf_polylines(TextWriter &out, const std::vector<std::vector<Eigen::Vector2d>> &paths, const char *layer, int flag)
+{
+  for (auto &path: paths) {
+    out << "0\nPOLYLINE\n8\n" << layer << "\n66\n1\n70\n" << std::to_string(flag) << "\n10\n0\n20\n0\n30\n0\n";
+    for (auto &p: path) {
+      out << "0\nVERTEX\n8\n" << layer << "\n10\n" << p.x() << "\n20\n" << p.y() << "\n30\n0\n";
+    }
+    out << "0\nSEQEND\n8\n" << layer << "\n";
+  }
+}
+
+// R12 ascii dxf in millimetres, the cuts on layer CUT as closed polylines and the folds on the layers
+// SCORE_VALLEY and SCORE_MOUNTAIN. R12 has no unit header, the cutter has to read the file in millimetres.
+void write_dxf(TextWriter &out, const CutPaths &paths)
+{
+  out << "0\nSECTION\n2\nTABLES\n0\nTABLE\n2\nLAYER\n70\n3\n";
+  out << "0\nLAYER\n2\nSCORE_VALLEY\n70\n0\n62\n5\n6\nCONTINUOUS\n";
+  out << "0\nLAYER\n2\nSCORE_MOUNTAIN\n70\n0\n62\n3\n6\nCONTINUOUS\n";
+  out << "0\nLAYER\n2\nCUT\n70\n0\n62\n1\n6\nCONTINUOUS\n";
+  out << "0\nENDTAB\n0\nENDSEC\n0\nSECTION\n2\nENTITIES\n";
+  // the scores go first so that no island comes loose before it is scored
+  write_dxf_polylines(out, paths.valleys, "SCORE_VALLEY", 0);
+  write_dxf_polylines(out, paths.mountains, "SCORE_MOUNTAIN", 0);
+  write_dxf_polylines(out, paths.cuts, "CUT", 1);
+  out << "0\nENDSEC\n0\nEOF\n";
+}
+
+// hpgl in plotter units of 1/40 mm, the valley scores with pen 2, the mountain scores with pen 3 and then
+// the cuts with pen 1. The writer is expected to have no decimals.
+void write_hpgl(TextWriter &out, const CutPaths &paths)
+{
+  const int pens[3] = {2, 3, 1};
+  const std::vector<std::vector<Eigen::Vector2d>>* layers[3] = {&paths.valleys, &paths.mountains, &paths.cuts};
+  out << "IN;\n";
+  for (int l = 0; l < 3; l++) {
+    bool closed = pens[l] == 1;
+    out << "SP" << std::to_string(pens[l]) << ";\n";
+    for (auto &path: *layers[l]) {
+      out << "PU" << path[0].x()*HPGL_UNITS_PER_MM << ',' << path[0].y()*HPGL_UNITS_PER_MM << ";PD";
+      for (int i = 1; i <= path.size(); i++) {
+        // a cut comes back to its first vertex
+        if (i == path.size() && !closed) break;
+        const Eigen::Vector2d &p = path[i%path.size()];
+        out << (i == 1? "" : ",") << p.x()*HPGL_UNITS_PER_MM << ',' << p.y()*HPGL_UNITS_PER_MM;
+      }
+      out << ";\n";
+    }
+  }
+  out << "PU;SP0;\n";
+}
+
+// Draw Gouraud shaded triangles on white into an rgb image of width x height pixels, rows from the top.
+// points are in pixels with y going down, three per triangle, and colors are 0-255 for each point. The
+// triangles are sorted into bands of BAKE_BAND_ROWS rows and the bands are drawn in parallel, a pixel is
+// covered when its centre is inside or on the edge of a triangle so no gaps open between neighbours.
+void rasterize_triangles(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector3d> &colors, int width, int height, std::vector<unsigned char> &rgb)
+{
+  rgb.assign(3*(size_t)width*height, 255);
+  int bandCnt = (height+BAKE_BAND_ROWS-1)/BAKE_BAND_ROWS;
+  std::vector<std::vector<int>> bands(bandCnt);
+  for (int t = 0; t+2 < points.size(); t += 3) {
+    double minY = std::min(points[t].y(), std::min(points[t+1].y(), points[t+2].y()));
+    double maxY = std::max(points[t].y(), std::max(points[t+1].y(), points[t+2].y()));
+    int first = std::max(0, (int)floor(minY)/BAKE_BAND_ROWS), last = std::min(bandCnt-1, (int)floor(maxY)/BAKE_BAND_ROWS);
+    for (int b = first; b <= last; b++) {
+      bands[b].push_back(t);
+    }
+  }
+  parallel_for(bandCnt, [&](int b) {
+    int top = b*BAKE_BAND_ROWS, bottom = std::min(height, top+BAKE_BAND_ROWS);
+    for (int t: bands[b]) {
+      Eigen::Vector2d p0 = points[t], p1 = points[t+1], p2 = points[t+2];
+      double area = (p1-p0).x()*(p2-p0).y()-(p1-p0).y()*(p2-p0).x();
+      if (fabs(area) < ESP) continue;
+      int minX = std::max(0, (int)floor(std::min(p0.x(), std::min(p1.x(), p2.x())))), maxX = std::min(width-1, (int)floor(std::max(p0.x(), std::max(p1.x(), p2.x()))));
+      int minY = std::max(top, (int)floor(std::min(p0.y(), std::min(p1.y(), p2.y())))), maxY = std::min(bottom-1, (int)floor(std::max(p0.y(), std::max(p1.y(), p2.y()))));
+      for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+          Eigen::Vector2d c(x+0.5, y+0.5);
+          double w0 = ((p2-p1).x()*(c-p1).y()-(p2-p1).y()*(c-p1).x())/area;
+          double w1 = ((p0-p2).x()*(c-p2).y()-(p0-p2).y()*(c-p2).x())/area;
+          double w2 = 1.-w0-w1;
+          // slightly outside the edges still counts, for the centres right on a shared edge
+          if (w0 < -ESP || w1 < -ESP || w2 < -ESP) continue;
+          Eigen::Vector3d color = w0*colors[t]+w1*colors[t+1]+w2*colors[t+2];
+          unsigned char* pixel = &rgb[3*((size_t)y*width+x)];
+          for (int k = 0; k < 3; k++) {
+            pixel[k] = (unsigned char)std::min(255., std::max(0., color(k)+0.5));
+          }
+        }
+      }
+    }
+  });
+}
+
+// order the paths for the cutter and write them to a dxf, or to hpgl for any other extension
+void export_cut_paths(std::string path, CutPaths &paths)
+{
+  Eigen::Vector2d pen(0., 0.);
+  order_paths(paths.valleys, false, pen);
+  order_paths(paths.mountains, false, pen);
+  order_paths(paths.cuts, true, pen);
+  std::ofstream file(path);
+  bool dxf = path.size() > 4 && path.substr(path.size()-4) == ".dxf";
+  TextWriter out(file, dxf? SVG_PAGE_PRECISION : 0);
+  if (dxf)
+    write_dxf(out, paths);
+  else
+    write_hpgl(out, paths);
+}
+
 Eigen::MatrixXd get_ortho_matrix(double l, double r, double b, double t, double n, double f) {
   Eigen::Matrix4d ortho = Eigen::MatrixXd::Identity(4,4);
   ortho.col(0)(0) = 2.0/(r-l); ortho.col(3)(0) = -(r+l)/(r-l);
@@ -344,23 +1700,29 @@ std::string replace_all(std::string str, const std::string& from, const std::str
     return str;
 }
 
-std::string get_svg_root_template() {
-  std::string svg_root_template = 
-  "<svg xmlns='http://www.w3.org/2000/svg' version='1.200000' width='100%' height='100%' viewBox='-1 -1 2 2' xmlns:xlink='http://www.w3.org/1999/xlink'>\
-    <g transform='matrix(0.5, 0.0, 0.0, $d, 0.0, 0.3)'>\
-    $TG\
-    </g>\
-  </svg>";
-  return svg_root_template;
+// opening tag of a sheet of the given size in millimetres, the strokes are given in millimetres too
+std::string get_svg_sheet_header(double width, double height) {
+  std::string svg_sheet_template = 
+  "<svg xmlns='http://www.w3.org/2000/svg' version='1.200000' width='$Wmm' height='$Hmm' viewBox='0 0 $W $H'>\
+    <style>[stroke='black'] { stroke-width: 0.2 } .mountain { stroke-dasharray: 4 1.2 0.8 1.2 } .valley, .fold { stroke-dasharray: 2.4 1.6 }\
+    .glue { font-family: sans-serif; font-size: $Spx; text-anchor: middle; dominant-baseline: central }</style>";
+  std::ostringstream w, h, size;
+  w << width; h << height; size << GLUE_LABEL_SIZE;
+  svg_sheet_template = replace_all(svg_sheet_template, "$S", size.str());
+  svg_sheet_template = replace_all(svg_sheet_template, "$W", w.str());
+  return replace_all(svg_sheet_template, "$H", h.str());
 }
 
-std::string get_tri_g_template() {
-  std::string TRI_G_TEMPLATE = 
-  "<g>\
-      <polyline points='$AX,$AY $BX,$BY $CX,$CY, $AX,$AY' stroke='' stroke-width='1' fill='rgb(255, 255, 255)'/>\
-      <polyline points='$AX,$AY $BX,$BY $CX,$CY, $AX,$AY' stroke='black' stroke-width='0.003' fill='none' />\
-  </g>";
-  return TRI_G_TEMPLATE;
+// width and height of a portrait sheet in millimetres
+Eigen::Vector2d get_paper_size(int paper) {
+  switch (paper) {
+    case PAPER_LETTER:
+      return Eigen::Vector2d(215.9, 279.4);
+    case PAPER_A3:
+      return Eigen::Vector2d(297., 420.);
+    default:
+      return Eigen::Vector2d(210., 297.);
+  }
 }
 
 std::string get_path_template() {
@@ -424,6 +1786,176 @@ Eigen::Vector3d get_vertical_vec(Eigen::Vector3d vech3, Eigen::Vector3d rotAixs)
   return vertrical;
 }
 
+double point_segment_dist(Eigen::Vector3d p, Eigen::Vector3d a, Eigen::Vector3d b) {
+  Eigen::Vector3d ab = b-a;
+  double len2 = ab.squaredNorm();
+  if (len2 < ESP) return (p-a).norm();
+  double t = fmax(0., fmin(1., (p-a).dot(ab)/len2));
+  return (p-(a+t*ab)).norm();
+}
+
+static double orient_2d(double ax, double ay, double bx, double by, double cx, double cy) {
+  return (bx-ax)*(cy-ay) - (by-ay)*(cx-ax);
+}
+
+static bool segments_cross(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy) {
+  // relative tolerance, segments that only touch or run along each other do not count
+  double eps = ESP * fmax((bx-ax)*(bx-ax)+(by-ay)*(by-ay), (dx-cx)*(dx-cx)+(dy-cy)*(dy-cy));
+  double d1 = orient_2d(cx, cy, dx, dy, ax, ay), d2 = orient_2d(cx, cy, dx, dy, bx, by);
+  double d3 = orient_2d(ax, ay, bx, by, cx, cy), d4 = orient_2d(ax, ay, bx, by, dx, dy);
+  return ((d1 > eps && d2 < -eps) || (d1 < -eps && d2 > eps)) && ((d3 > eps && d4 < -eps) || (d3 < -eps && d4 > eps));
+}
+
+// (px, py) strictly inside triangle t of T, points on its edges do not count
+static bool point_in_triangle_2d(const Eigen::MatrixXd &T, int t, double px, double py) {
+  double area = orient_2d(T(0, t), T(1, t), T(2, t), T(3, t), T(4, t), T(5, t));
+  if (fabs(area) < ESP*ESP) return false;
+  for (int k = 0; k < 3; k++) {
+    int a = 2*k, b = 2*((k+1)%3);
+    if (orient_2d(T(a, t), T(a+1, t), T(b, t), T(b+1, t), px, py)/area <= ESP) return false;
+  }
+  return true;
+}
+
+// Two triangles overlap when edges of them cross, or else when one lies inside the other, which puts its
+// centroid inside the other. Identical triangles are caught by the centroid too.
+static bool triangles_overlap_2d(const Eigen::MatrixXd &T, int s, int t) {
+  for (int i = 0; i < 3; i++) {
+    int a = 2*i, b = 2*((i+1)%3);
+    for (int j = 0; j < 3; j++) {
+      int c = 2*j, d = 2*((j+1)%3);
+      if (segments_cross(T(a, s), T(a+1, s), T(b, s), T(b+1, s), T(c, t), T(c+1, t), T(d, t), T(d+1, t))) return true;
+    }
+  }
+  return point_in_triangle_2d(T, t, (T(0, s)+T(2, s)+T(4, s))/3., (T(1, s)+T(3, s)+T(5, s))/3.)
+    || point_in_triangle_2d(T, s, (T(0, t)+T(2, t)+T(4, t))/3., (T(1, t)+T(3, t)+T(5, t))/3.);
+}
+
+// Segment tree over ranks of y, every node keeps a linked list of boxes. Boxes that left the sweep line are
+// unlinked when their node is next visited.
+struct BoxTree {
+  std::vector<int> head, box, next;
+
+  explicit BoxTree(int m): head(4*m, -1) {}
+
+  void push(int node, int id) {
+    box.push_back(id);
+    next.push_back(head[node]);
+    head[node] = box.size()-1;
+  }
+
+  // keep box id at the nodes that cover the ranks [a, b]
+  void insertRange(int node, int lo, int hi, int a, int b, int id) {
+    if (b < lo || hi < a) return;
+    if (a <= lo && hi <= b) {
+      push(node, id);
+      return;
+    }
+    int mid = (lo+hi)/2;
+    insertRange(2*node, lo, mid, a, b, id);
+    insertRange(2*node+1, mid+1, hi, a, b, id);
+  }
+
+  // pair box i with the boxes kept at a node that are still on the sweep line
+  void report(int node, int i, const std::vector<bool> &active, std::vector<std::pair<int, int>> &overlaps) {
+    for (int* link = &head[node]; *link >= 0; ) {
+      int j = box[*link];
+      if (!active[j]) {
+        *link = next[*link];
+        continue;
+      }
+      overlaps.push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+      link = &next[*link];
+    }
+  }
+
+  // boxes kept at the nodes on the path from the root to the leaf of rank r
+  void reportPoint(int m, int r, int i, const std::vector<bool> &active, std::vector<std::pair<int, int>> &overlaps) {
+    for (int node = 1, lo = 0, hi = m-1; ; ) {
+      report(node, i, active, overlaps);
+      if (lo == hi) break;
+      int mid = (lo+hi)/2;
+      if (r <= mid) {
+        node = 2*node; hi = mid;
+      }
+      else {
+        node = 2*node+1; lo = mid+1;
+      }
+    }
+  }
+};
+
+// B holds one box per column as (minx, miny, maxx, maxy), every pair of boxes that overlap or touch is
+// reported once. A line sweeps along x. The y intervals of the boxes on the sweep line that contain the
+// lowest y of a new box are found in a segment tree over the y coordinates, the ones starting above it in
+// a set ordered by their lowest y. The sweep takes O(n log n + k) for k overlapping pairs.
+std::vector<std::pair<int, int>> find_box_overlaps(const Eigen::MatrixXd &B) {
+  int n = B.cols();
+  std::vector<std::pair<double, int>> events;
+  events.reserve(2*n);
+  std::vector<double> ys;
+  ys.reserve(2*n);
+  for (int i = 0; i < n; i++) {
+    // insert events sort before remove events at the same x, so touching boxes meet
+    events.push_back(std::make_pair(B(0, i), -i-1));
+    events.push_back(std::make_pair(B(2, i), i));
+    ys.push_back(B(1, i));
+    ys.push_back(B(3, i));
+  }
+  std::sort(events.begin(), events.end());
+  std::sort(ys.begin(), ys.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+  int m = std::max<int>(1, ys.size());
+  BoxTree spans(m);
+  std::vector<bool> active(n, false);
+  std::set<std::pair<double, int>> starts;
+  std::vector<std::pair<int, int>> overlaps;
+  for (auto &event: events) {
+    if (event.second >= 0) {
+      int i = event.second;
+      active[i] = false;
+      starts.erase(std::make_pair(B(1, i), i));
+      continue;
+    }
+    int i = -event.second-1;
+    int lo = std::lower_bound(ys.begin(), ys.end(), B(1, i))-ys.begin();
+    int hi = std::lower_bound(ys.begin()+lo, ys.end(), B(3, i))-ys.begin();
+    spans.reportPoint(m, lo, i, active, overlaps);
+    for (auto it = starts.upper_bound(std::make_pair(B(1, i), n)); it != starts.end() && it->first <= B(3, i); it++) {
+      overlaps.push_back(std::make_pair(std::min(i, it->second), std::max(i, it->second)));
+    }
+    active[i] = true;
+    starts.insert(std::make_pair(B(1, i), i));
+    spans.insertRange(1, 0, m-1, lo, hi, i);
+  }
+  return overlaps;
+}
+
+// T holds one triangle per column as (x1, y1, x2, y2, x3, y3), returns the pairs of triangles whose insides
+// overlap. Triangles that only share edges or vertexes do not count.
+std::vector<std::pair<int, int>> find_triangle_overlaps(const Eigen::MatrixXd &T) {
+  Eigen::MatrixXd B(4, T.cols());
+  for (int t = 0; t < T.cols(); t++) {
+    B.col(t) << fmin(T(0, t), fmin(T(2, t), T(4, t))), fmin(T(1, t), fmin(T(3, t), T(5, t))),
+                fmax(T(0, t), fmax(T(2, t), T(4, t))), fmax(T(1, t), fmax(T(3, t), T(5, t)));
+  }
+  std::vector<std::pair<int, int>> overlaps;
+  for (auto &pair: find_box_overlaps(B)) {
+    if (triangles_overlap_2d(T, pair.first, pair.second)) overlaps.push_back(pair);
+  }
+  return overlaps;
+}
+
+const float* FloatMat4::data(const Eigen::Matrix4d &M)
+{
+  if (source.rows() != 4 || source.cols() != 4 || source != M) {
+    source = M;
+    value = M.cast<float>();
+  }
+  return value.data();
+}
+
 Eigen::VectorXf v_to_float(Eigen::VectorXd in) {
   Eigen::VectorXf out = in.cast<float>();
   return out;
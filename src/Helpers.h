@@ -5,6 +5,11 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
@@ -97,6 +102,35 @@ public:
     void free();
 };
 
+// Float buffer read in the shaders through a samplerBuffer, a column of M is a texel of four floats
+class TextureBufferObject
+{
+public:
+    typedef unsigned int GLuint;
+    typedef int GLint;
+
+    GLuint id;
+    GLuint buffer;
+    GLuint cols;
+
+    TextureBufferObject() : id(0), buffer(0), cols(0) {}
+
+    // Create a new empty texture buffer
+    void init();
+
+    // Updates the buffer with a matrix M of 4 rows
+    void update(const Eigen::MatrixXf& M);
+
+    // Overwrites the texels from first on with the columns of M, the buffer keeps its size
+    void update(int first, const Eigen::MatrixXf& M);
+
+    // Select this texture buffer on a texture unit for subsequent draw calls
+    void bind(int unit);
+
+    // Release the ids
+    void free();
+};
+
 // This class wraps an OpenGL program composed of two shaders
 class Program
 {
@@ -106,14 +140,16 @@ public:
 
   GLuint vertex_shader;
   GLuint fragment_shader;
+  GLuint geometry_shader;
   GLuint program_shader;
 
-  Program() : vertex_shader(0), fragment_shader(0), program_shader(0) { }
+  Program() : vertex_shader(0), fragment_shader(0), geometry_shader(0), program_shader(0) { }
 
-  // Create a new shader from the specified source strings
+  // Create a new shader from the specified source strings, the geometry shader is optional
   bool init(const std::string &vertex_shader_string,
   const std::string &fragment_shader_string,
-  const std::string &fragment_data_name);
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string = "");
 
   // Select this shader for subsequent draw calls
   void bind();
@@ -124,7 +160,8 @@ public:
   // Return the OpenGL handle of a named shader attribute (-1 if it does not exist)
   GLint attrib(const std::string &name) const;
 
-  // Return the OpenGL handle of a uniform attribute (-1 if it does not exist)
+  // Return the OpenGL handle of a uniform attribute (-1 if it does not exist), looked up in the program
+  // only the first time a name is asked for
   GLint uniform(const std::string &name) const;
 
   // Bind a per-vertex array attribute
@@ -132,6 +169,158 @@ public:
 
   GLuint create_shader_helper(GLint type, const std::string &shader_string);
 
+private:
+  mutable std::unordered_map<std::string, GLint> uniforms;
+};
+
+// Float copy of a 4x4 matrix for glUniformMatrix4fv. It is converted again only when the matrix it is
+// asked for differs from the last one, so an unchanged matrix costs a compare and no allocation.
+class FloatMat4
+{
+public:
+    const float* data(const Eigen::Matrix4d &M);
+
+private:
+    Eigen::MatrixXd source;
+    Eigen::MatrixXf value;
+};
+
+// Occupancy of a grid of square cells, one bit per cell and 64 cells per word. Rows grow downwards.
+class OccupancyBitmap
+{
+public:
+    int w, h, words;
+    std::vector<uint64_t> bits;
+
+    OccupancyBitmap() : w(0), h(0), words(0) {}
+    OccupancyBitmap(int w, int h);
+
+    bool get(int x, int y) const;
+    void set(int x, int y);
+
+    // Mark every cell touched by the triangle abc, given in cell units
+    void fillTriangle(Eigen::Vector2d a, Eigen::Vector2d b, Eigen::Vector2d c);
+
+    // Grow the occupied cells by r cells in every direction, the bitmap grows by r on each side
+    void dilate(int r);
+
+    // Bit x of free is set if mask fits with its top left cell on (x, y), rows below h are empty
+    void freePositions(const OccupancyBitmap &mask, int y, std::vector<uint64_t> &free) const;
+
+    // Occupy the cells of mask with its top left cell on (x, y), the bitmap grows downwards if needed
+    void place(const OccupancyBitmap &mask, int x, int y);
+
+    int count() const;
+};
+
+// Buffered text output. Numbers are formatted straight into the buffer with a fixed number of decimals
+// and no trailing zeros, the buffer goes to the stream whenever it is full.
+class TextWriter
+{
+public:
+    TextWriter(std::ostream &out, int precision);
+    TextWriter(std::ostream &out, int precision, int bufferSize);
+    ~TextWriter();
+
+    TextWriter& operator<<(const char *str);
+    TextWriter& operator<<(const std::string &str);
+    TextWriter& operator<<(char c);
+    TextWriter& operator<<(double value);
+
+    void flush();
+
+private:
+    std::ostream &out;
+    int precision;
+    long long unit;
+    std::vector<char> buffer;
+    int used;
+
+    void write(const char *str, int len);
+};
+
+// Island paths of an svg sheet
+class SvgWriter : public TextWriter
+{
+public:
+    SvgWriter(std::ostream &out, int precision);
+    SvgWriter(std::ostream &out, int precision, int bufferSize);
+
+    // The cut outline of an island made of closed loops, filled white
+    void outline(const std::vector<std::vector<Eigen::Vector2d>> &loops);
+    // Fold lines given as pairs of end points, the style comes from the class in the root template
+    void folds(const std::vector<Eigen::Vector2d> &segments, const char *style);
+    // Glue numbers of the cut edges, centred a little inside the island from the edge midpoints
+    void labels(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector2d> &inward, const std::vector<int> &numbers);
+};
+
+// Content stream of a pdf page, coordinates are in points
+class PdfContent : public TextWriter
+{
+public:
+    PdfContent(std::ostream &out, int precision, int bufferSize);
+
+    // The cut outline of an island made of closed loops, filled white and stroked
+    void outline(const std::vector<std::vector<Eigen::Vector2d>> &loops);
+    // Fold lines given as pairs of end points, dashed by style
+    void folds(const std::vector<Eigen::Vector2d> &segments, const char *style);
+    // Glue numbers of the cut edges in Helvetica, y goes up
+    void labels(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector2d> &inward, const std::vector<int> &numbers);
+};
+
+// Content of a page with baked colours, the outlines are only stroked so the page image under them shows
+class PdfBakedContent : public PdfContent
+{
+public:
+    PdfBakedContent(std::ostream &out, int precision, int bufferSize);
+
+    void outline(const std::vector<std::vector<Eigen::Vector2d>> &loops);
+};
+
+// Pdf document streamed to a file a page at a time. Only the byte offsets of the objects are kept until
+// the xref table is written on close, so memory does not grow with the content of the pages.
+class PdfWriter
+{
+public:
+    PdfWriter(std::string path);
+    ~PdfWriter();
+
+    // Start a page of width x height points, the content goes to the page until endPage
+    void beginPage(double width, double height);
+    // An rgb image of width x height pixels stretched over the next page under its content, given before
+    // beginPage since objects cannot nest in the content stream
+    void pageImage(int width, int height, const std::vector<unsigned char> &rgb);
+    PdfWriter& operator<<(const std::string &content);
+    void endPage();
+
+    // Write the page tree, the catalog, the xref table and the trailer
+    void close();
+
+private:
+    std::ofstream file;
+    long long pos;
+    std::vector<long long> offsets;
+    std::vector<int> pages;
+    int fontId, contentId, lengthId, imageId;
+    long long streamStart;
+    double pageWidth, pageHeight;
+
+    int newObject();
+    void beginObject(int id);
+    void write(const std::string &str);
+};
+
+// Cut and score paths of a sheet for laser cutters and plotters, in millimetres with y going up. The cuts
+// are the closed outlines of the islands, the scores are the fold lines as open paths. Mountain folds are
+// kept apart from the valley folds, the folds that are not split go with the valleys.
+class CutPaths
+{
+public:
+    std::vector<std::vector<Eigen::Vector2d>> cuts, valleys, mountains;
+
+    void outline(const std::vector<std::vector<Eigen::Vector2d>> &loops);
+    void folds(const std::vector<Eigen::Vector2d> &segments, const char *style);
+    void append(const CutPaths &paths);
 };
 
 // From: https://blog.nobel-joergensen.com/2013/01/29/debugging-opengl-using-glgeterror/
@@ -156,6 +345,29 @@ void _check_gl_error(const char *file, int line);
 #define CONE_OFF_PATH "../data/cone.off"
 #define FOX_OFF_PATH "../data/fox.off"
 #define EXPORT_PATH "../output/export.svg"
+#define EXPORT_PAGE_PATH "../output/export_page_"
+#define SVG_PAGE_PRECISION 3
+#define TEXT_BUFFER_SIZE 65536
+#define SVG_ISLAND_BUFFER_SIZE 4096
+#define EXPORT_BATCH_SIZE 256
+#define EXPORT_PDF_PATH "../output/export.pdf"
+#define PDF_POINTS_PER_MM (72./25.4)
+#define BAKE_DPI 300.
+#define BAKE_MAX_PIXELS 40000000
+#define BAKE_BAND_ROWS 32
+#define EXPORT_DXF_PATH "../output/export.dxf"
+#define EXPORT_HPGL_PATH "../output/export.plt"
+#define HPGL_UNITS_PER_MM 40.
+#define EXPORT_OBJ_PATH "../output/export.obj"
+#define OBJ_PRECISION 6
+#define TOUR_2OPT_WINDOW 32
+#define TOUR_2OPT_PASSES 4
+#define SVG_MOUNTAIN_VALLEY 1
+#define GLUE_LABEL_SIZE 2.
+#define GLUE_LABEL_OFFSET 1.5
+#define GLUE_TAB_RATIO 0.3
+#define GLUE_TAB_HEIGHT 6.
+#define GLUE_TAB_TRIES 3
 #define WIREFRAME 0
 #define FLAT_SHADING 1
 #define PHONG_SHADING 2
@@ -167,11 +379,46 @@ void _check_gl_error(const char *file, int line);
 #define DIST_MAX 10000.
 #define CILCK_ACTION 1
 #define RAY_ACTION 2
+#define EDGE_ACTION 3
 #define ESP 1e-6
 #define LEFTSUBWINDOW 0
 #define RIGHTSUBWINDOW 1
+#define EDGE_FREE 0
+#define EDGE_CUT 1
+#define EDGE_FOLD 2
+#define ISLAND_MERGE_SIZE 64
+#define CHART_FACE_THRESHOLD 20000
+#define CHART_TARGET_SIZE 2000
+#define CHART_MAX_ANGLE 60.
+#define COPLANAR_ANGLE 0.5
+// how far a polygon vertex reached twice may land from itself, relative to the edge it is reached through
+#define COPLANAR_CLOSE_TOLERANCE 1e-12
+#define DECIMATE_TARGET_FACES 5000
+#define DECIMATE_MAX_ERROR 0.005
+// the same as DECIMATE_TARGET_FACES: decimation only leaves more faces when DECIMATE_MAX_ERROR stops it,
+// and those detailed models are the ones slow enough to unfold to need a proxy
+#define PROXY_FACE_THRESHOLD DECIMATE_TARGET_FACES
+#define PROXY_TARGET_FACES 1500
+#define ISLAND_MARGIN 0.02
+#define LAYOUT_PACK 0
+#define LAYOUT_NEST 1
+#define LAYOUT_PAGES 2
+#define LAYOUT_MODE_NUMBER 3
+#define NEST_GRID_WIDTH 512
+#define NEST_ROTATIONS 4
+#define PAPER_A4 0
+#define PAPER_LETTER 1
+#define PAPER_A3 2
+#define PAPER_SIZE_NUMBER 3
+#define PAGE_MARGIN 10.
+#define PRINT_MODEL_SIZE 100.
+#define PAGE_BUDGET_MAX 8
+#define PAGE_SCALE_TOLERANCE 1e-3
+#define PAGE_OPEN_LIMIT 4
 
 bool loadMeshfromOFF(std::string filepath, Eigen::MatrixXd &V, Eigen::MatrixXd &C, Eigen::VectorXi &IDX);
+void decimate_mesh(Eigen::MatrixXd &V, Eigen::MatrixXd &C, Eigen::VectorXi &IDX, int targetFaces, double maxError);
+void cluster_mesh(Eigen::MatrixXd &V, Eigen::VectorXi &IDX, int targetFaces);
 Eigen::MatrixXd get_bounding_box(Eigen::MatrixXd V);
 Eigen::MatrixXd get_bounding_box_2d(Eigen::MatrixXd V);
 Eigen::Vector3d to_3(Eigen::Vector4d X);
@@ -181,12 +428,46 @@ Eigen::Vector4d to_4_vec(Eigen::Vector3d vec);
 Eigen::Vector4d to_4_point(Eigen::Vector3d vec);
 Eigen::Matrix4d mat_to_4(Eigen::Matrix3d M);
 Eigen::Vector3d get_vertical_vec(Eigen::Vector3d vech3, Eigen::Vector3d rotAixs);
+double point_segment_dist(Eigen::Vector3d p, Eigen::Vector3d a, Eigen::Vector3d b);
 Eigen::Matrix4d get_rotate_mat(double rad, Eigen::Vector3d edgeA, Eigen::Vector3d edgeB);
 Eigen::Matrix4d get_rotate_mat(double rotDot, double rotSign, Eigen::Vector3d edgeA, Eigen::Vector3d edgeB);
 Eigen::VectorXf v_to_float(Eigen::VectorXd in);
 Eigen::MatrixXf m_to_float(Eigen::MatrixXd in);
 
+std::vector<std::pair<int, int>> find_box_overlaps(const Eigen::MatrixXd &B);
+std::vector<std::pair<int, int>> find_triangle_overlaps(const Eigen::MatrixXd &T);
+bool convex_overlap_2d(const std::vector<Eigen::Vector2d> &p, const std::vector<Eigen::Vector2d> &q);
+std::vector<Eigen::Vector2d> convex_hull_2d(const Eigen::MatrixXd &P);
+double min_area_rect_angle(const std::vector<Eigen::Vector2d> &hull);
+std::vector<Eigen::Vector2d> pack_skyline(const std::vector<Eigen::Vector2d> &sizes, double paperW, double &paperH);
+std::vector<Eigen::Vector3d> paginate_boxes(const std::vector<Eigen::Vector2d> &sizes, double pageW, double pageH, int &pageCnt);
+double fit_page_scale(const std::vector<Eigen::Vector2d> &sizes, double margin, Eigen::Vector2d page, int pageBudget);
+std::vector<Eigen::Vector3i> nest_bitmaps(const std::vector<std::vector<OccupancyBitmap>> &masks, int paperW, int &paperH);
+double order_paths(std::vector<std::vector<Eigen::Vector2d>> &paths, bool closed, Eigen::Vector2d &pen);
+void write_dxf(TextWriter &out, const CutPaths &paths);
+void write_hpgl(TextWriter &out, const CutPaths &paths);
+void export_cut_paths(std::string path, CutPaths &paths);
+void rasterize_triangles(const std::vector<Eigen::Vector2d> &points, const std::vector<Eigen::Vector3d> &colors, int width, int height, std::vector<unsigned char> &rgb);
 std::string replace_all(std::string str, const std::string& from, const std::string& to);
-std::string get_tri_g_template();
-std::string get_svg_root_template();
+std::string get_svg_sheet_header(double width, double height);
+Eigen::Vector2d get_paper_size(int paper);
 std::string get_path_template();
+
+// Run func(i) for i in [0, n) on all hardware threads, indices are handed out one at a time
+template <typename Func>
+void parallel_for(int n, Func func) {
+  int workers = std::min<int>(n, std::max(1u, std::thread::hardware_concurrency()));
+  std::atomic<int> next(0);
+  auto work = [&]() {
+    int i;
+    while ((i = next++) < n) func(i);
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < workers; t++) {
+    threads.push_back(std::thread(work));
+  }
+  work();
+  for (std::thread &thread: threads) {
+    thread.join();
+  }
+}
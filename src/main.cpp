@@ -8,6 +8,7 @@
 #include <fstream>
 #include <cmath>
 #include <map>
+#include <unordered_map>
 #include <queue>
 #include <set>
 #include <cassert>
@@ -57,6 +58,8 @@ bool pre_aspect_is_x = false;
 bool drag = false;
 double hit_dist;
 Eigen::Vector4d pre_cursor_point;
+// the pdf export prints the vertex colours under the nets
+bool bake_colors = false;
 
 class Camera {
     public:
@@ -70,6 +73,9 @@ class Camera {
         Eigen::Vector3d right;
         Eigen::Vector3d forward;
         Eigen::Vector3d target;
+        // float copies of the matrices sent to the shaders
+        FloatMat4 ViewMatF;
+        FloatMat4 ProjectMatF;
 
         // bounding box
         double n, f, t, b, r, l;
@@ -234,11 +240,8 @@ class Mesh {
         double rotSign;
         double rotDot;
 
-        VertexArrayObject VAO;
-        VertexBufferObject VBO_P;
-
         Mesh() {}
-        Mesh(int id, Eigen::MatrixXd V, int v1, int v2, int v3, Eigen::Vector3i color=LIGHTGREY) {
+        Mesh(int id, const Eigen::MatrixXd &V, int v1, int v2, int v3, Eigen::Vector3i color=LIGHTGREY) {
             this->id = id;
             this->color = color.cast<double>()/255.;
             this->vids.push_back(v1); this->vids.push_back(v2); this->vids.push_back(v3);
@@ -254,17 +257,6 @@ class Mesh {
             this->rotRad = 0.;
             this->rotDot = 0.;
             this->rotSign = 1;
-
-            this->VAO.init();
-            this->VAO.bind();
-            this->VBO_P.init();
-            this->updateVBOP();
-        }
-        void updateVBOP() {
-            int v1 = vids[0], v2 = vids[1], v3 = vids[2];
-            Eigen::Matrix3d fV;
-            fV << vid2fv[v1], vid2fv[v2], vid2fv[v3];
-            this->VBO_P.update(m_to_float(fV));
         }
         Eigen::Matrix3d getFlatV() {
             int v1 = vids[0], v2 = vids[1], v3 = vids[2];
@@ -344,6 +336,21 @@ class Node {
             this->meshId = meshId;
         }
 };
+class GlueTab {
+    public:
+        // the tab hangs from edge k of the mesh, its outer corners go from the side of vertex k
+        int meshId, k;
+        Eigen::Vector3d cornerA, cornerB;
+        bool mountain;
+
+        GlueTab(int meshId, int k, Eigen::Vector3d cornerA, Eigen::Vector3d cornerB, bool mountain) {
+            this->meshId = meshId;
+            this->k = k;
+            this->cornerA = cornerA;
+            this->cornerB = cornerB;
+            this->mountain = mountain;
+        }
+};
 class CompareWeight {
     public:
         bool operator()(Node a, Node b) {
@@ -358,6 +365,27 @@ class Grid {
             this->sizex = sizex; this->sizey = sizey;
         }
         void addItem(Mesh* mesh) {
+            this->addBox(mesh->id, get_bounding_box_2d(mesh->getFlatV()));
+        }
+        // add an item by its bounding box, for shapes that are not meshes
+        void addBox(int id, Eigen::MatrixXd boundingBox) {
+            double minx = boundingBox.col(0)(0), maxx = boundingBox.col(1)(0);
+            double miny = boundingBox.col(0)(1), maxy = boundingBox.col(1)(1);
+            double x = minx;
+            while (x < maxx+sizex) {
+                double y = miny;
+                while (y < maxy+sizey) {
+                    int r, c;
+                    getCellIdx(x, y, r, c);
+                    if (std::find(rows[r][c].begin(), rows[r][c].end(), id) == rows[r][c].end())
+                        rows[r][c].push_back(id);
+                    y += sizey;
+                }
+                x += sizex;
+            }
+        }
+        void removeItem(Mesh* mesh) {
+            // walk the same cells addItem touched, so call it before the flat position changes
             Eigen::MatrixXd boundingBox = get_bounding_box_2d(mesh->getFlatV());
             double minx = boundingBox.col(0)(0), maxx = boundingBox.col(1)(0);
             double miny = boundingBox.col(0)(1), maxy = boundingBox.col(1)(1);
@@ -367,8 +395,8 @@ class Grid {
                 while (y < maxy+sizey) {
                     int r, c;
                     getCellIdx(x, y, r, c);
-                    if (std::find(rows[r][c].begin(), rows[r][c].end(), mesh->id) == rows[r][c].end())
-                        rows[r][c].push_back(mesh->id);
+                    std::vector<int> &cell = rows[r][c];
+                    cell.erase(std::remove(cell.begin(), cell.end(), mesh->id), cell.end());
                     y += sizey;
                 }
                 x += sizex;
@@ -409,16 +437,36 @@ class FlattenObject {
         std::map<std::pair<int, int>, double> edge2weight;
         Grid* grid;
         std::map<int, int> idx2meshId;
-
-        Eigen::MatrixXd V;
+        std::vector<Node> polygonNodes;
+        std::set<int> flattened;
+        int rootId;
+        // sheet the island is printed on when the layout is paginated
+        int page;
+        // glue label, mesh id and edge k of every cut edge, the label is -1 if nothing is glued to the edge
+        std::vector<Eigen::Vector3i> glueEdges;
+        // glue tabs on the cut edges of this island
+        std::vector<GlueTab> tabs;
+
+        // edges the user forced to be cut or folded, owned by the 3d object
+        const std::set<Edge>* forcedCuts;
+        const std::set<Edge>* forcedFolds;
+        // coplanar polygon of every face and the faces of every polygon, owned by the 3d object
+        const std::vector<int>* face2poly;
+        const std::vector<std::vector<int>>* polys;
+
+        // 3 x n vertex positions, shared with the 3d object
+        const Eigen::MatrixXd* V;
         Eigen::MatrixXd fV;
         Eigen::VectorXi IDX;
 
         VertexArrayObject VAO;
         VertexBufferObject VBO_P;
         IndexBufferObject IBO_IDX;
+        // animation matrices of the faces in the order of fV, four texels per face
+        TextureBufferObject TBO_A;
 
         Eigen::MatrixXd ModelMat;
+        FloatMat4 ModelMatF;
         Eigen::MatrixXd T_to_ori;
         Eigen::Vector4d barycenter;
 
@@ -426,7 +474,7 @@ class FlattenObject {
             auto edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
             edge2meshes[edge].push_back(meshId);
             if (edge2weight.find(edge) == edge2weight.end())
-                edge2weight[edge] = (V.col(v1)-V.col(v2)).norm();
+                edge2weight[edge] = (V->col(v1)-V->col(v2)).norm();
         }
         void addNebMeshes(int v1, int v2, int meshId) {
             auto edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
@@ -473,19 +521,23 @@ class FlattenObject {
 
             return true;
         }
-        FlattenObject(Eigen::MatrixXd V, Eigen::VectorXi IDX, std::vector<bool> &meshFlattened) {
-            V.conservativeResize(3, V.cols());
-            this->V = V;
+        // grow an island out of the pending faces of IDX, the faces that do not fit stay pending
+        FlattenObject(const Eigen::MatrixXd &V, const Eigen::VectorXi &IDX, std::vector<int> &pending,
+                      const std::set<Edge>* forcedCuts = nullptr, const std::set<Edge>* forcedFolds = nullptr,
+                      const std::vector<int>* face2poly = nullptr, const std::vector<std::vector<int>>* polys = nullptr) {
+            this->V = &V;
             this->fV.resize(4, 0);
+            this->page = 0;
+            this->forcedCuts = forcedCuts;
+            this->forcedFolds = forcedFolds;
+            this->face2poly = face2poly;
+            this->polys = polys;
 
             // create V and F matrix
             std::cout << "create meshes" << std::endl;
             // std::vector<Mesh*> meshes;
-            for (int i = 0; i < IDX.rows(); i += 3) {
-                int meshId = i/3;
-                // std::cout << "check id " << i/3 << std::endl;
-                if (meshFlattened[i/3]) continue;
-                // std::cout << "ok id " << i/3 << std::endl;
+            for (int meshId: pending) {
+                int i = meshId*3;
                 int v1 = IDX(i), v2 = IDX(i+1), v3 = IDX(i+2);
                 meshes[meshId] = new Mesh(meshId, V, v1, v2, v3, WHITE);
                 // add edge
@@ -514,83 +566,589 @@ class FlattenObject {
             grid = new Grid();
 
             // maximal spaning tree(MST)
+            this->growIsland(pending.front());
+
+            // meshes left out of this island are recreated by the next island
+            for (auto it = meshes.begin(); it != meshes.end(); ) {
+                if (flattened.find(it->first) == flattened.end()) {
+                    delete it->second;
+                    it = meshes.erase(it);
+                }
+                else {
+                    it++;
+                }
+            }
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [this](int meshId) {
+                return this->flattened.find(meshId) != this->flattened.end();
+            }), pending.end());
+
+            this->initModel();
+        }
+        // grow an island out of meshes detached from other islands, the ones that do not fit stay in pool
+        FlattenObject(const Eigen::MatrixXd &V, std::vector<Mesh*> &pool,
+                      const std::set<Edge>* forcedCuts = nullptr, const std::set<Edge>* forcedFolds = nullptr,
+                      const std::vector<int>* face2poly = nullptr, const std::vector<std::vector<int>>* polys = nullptr) {
+            this->V = &V;
+            this->fV.resize(4, 0);
+            this->page = 0;
+            this->forcedCuts = forcedCuts;
+            this->forcedFolds = forcedFolds;
+            this->face2poly = face2poly;
+            this->polys = polys;
+            this->grid = new Grid();
+
+            for (Mesh* mesh: pool) {
+                meshes[mesh->id] = mesh;
+            }
+            this->growIsland(pool.front()->id);
+            pool = this->takeUnflattened(pool);
+
+            this->initModel();
+        }
+        // no OpenGL calls here, islands can be grown on worker threads
+        void initModel() {
+            this->updateFlatV();
+
+            // init model fields
+            this->ModelMat = Eigen::MatrixXd::Identity(4,4);
+            this->T_to_ori = Eigen::MatrixXd::Identity(4,4);
+            this->barycenter = Eigen::Vector4d(0.0, 0.0, 0.0, 1.0);
+        }
+        void updateFlatV() {
+            this->fV.resize(4, 3*flattened.size());
+            this->idx2meshId.clear();
+            int last = 0;
+            for (int meshId: flattened) {
+                Eigen::Matrix3d flatV = meshes[meshId]->getFlatV();
+                this->fV.col(last) = to_4_point(flatV.col(0));
+                this->fV.col(last+1) = to_4_point(flatV.col(1));
+                this->fV.col(last+2) = to_4_point(flatV.col(2));
+                this->idx2meshId[last] = meshId;
+                last += 3;
+            }
+        }
+        // update flat position to VBO, the buffers are created on first use from the main thread
+        void upload() {
+            if (this->VBO_P.id == 0) {
+                this->VAO.init();
+                this->VAO.bind();
+                this->VBO_P.init();
+                this->TBO_A.init();
+            }
+            this->VBO_P.update(m_to_float(this->fV));
+            this->uploadAnimation();
+        }
+        // upload the animation matrices of the faces, the vertex shader finds them by gl_VertexID/3
+        void uploadAnimation() {
+            Eigen::MatrixXf A(4, 4*this->flattened.size());
+            int last = 0;
+            for (int meshId: flattened) {
+                A.block<4, 4>(0, last) = meshes[meshId]->animeM.cast<float>();
+                last += 4;
+            }
+            this->TBO_A.update(A);
+        }
+        // re-upload the flat positions after the island has been edited. Islands merged during an unfold have no
+        // buffers yet, they may be on a worker thread or without a window and are uploaded when shown.
+        void refresh() {
+            this->updateFlatV();
+            if (this->VBO_P.id != 0) this->upload();
+        }
+        bool isForcedCut(Edge edge) {
+            return forcedCuts != nullptr && forcedCuts->find(edge) != forcedCuts->end();
+        }
+        double edgeWeight(Edge edge) {
+            // forced folds always win against the longest free edge
+            double weight = (V->col(edge.first)-V->col(edge.second)).norm();
+            if (forcedFolds != nullptr && forcedFolds->find(edge) != forcedFolds->end())
+                weight += DIST_MAX;
+            return weight;
+        }
+        void growIsland(int firstMeshId) {
             std::priority_queue<Node, std::vector<Node>, CompareWeight> pq;
-            std::set<int> flattened;
-            std::vector<double> dist(IDX.rows()/3, 0.);
+            std::map<int, double> dist;
 
             // flat first mesh
-            int firstMeshId = meshes.begin()->first;
             flattenFirst(firstMeshId, flattened);
             flattened.insert(firstMeshId);
             grid->addItem(meshes[firstMeshId]);
+            this->rootId = firstMeshId;
             dist[firstMeshId] = DIST_MAX;
-            pq.push(Node(DIST_MAX, std::make_pair(0,0), 0, firstMeshId));
-            // std::cout << "flattened first mesh" << std::endl;
-            // std::cout << "mesh flat V" << std::endl;
-            // std::cout << meshes[firstMeshId].getFlatV() << std::endl;
-            
+            pushNebMeshes(firstMeshId, pq, dist);
+            growFrom(pq, dist);
+        }
+        void pushNebMeshes(int meshId, std::priority_queue<Node, std::vector<Node>, CompareWeight> &pq, std::map<int, double> &dist) {
+            Mesh* curMesh = meshes[meshId];
+            for (auto meshNedge: curMesh->nebMeshes) {
+                int nebMeshId = meshNedge.first;
+                auto edge = meshNedge.second;
+                if (meshes.find(nebMeshId) == meshes.end() || flattened.find(nebMeshId) != flattened.end() || isForcedCut(edge))
+                    continue;
+                double weight = edgeWeight(edge);
+                // the rest of a polygon comes before anything else
+                if (samePolygon(meshId, nebMeshId))
+                    weight += 2*DIST_MAX;
+                if (weight > dist[nebMeshId]) {
+                    dist[nebMeshId] = weight;
+                    pq.push(Node(weight, edge, meshId, nebMeshId));
+                }
+            }
+        }
+        bool samePolygon(int meshId, int nebMeshId) {
+            return face2poly != nullptr && (*face2poly)[meshId] == (*face2poly)[nebMeshId];
+        }
+        bool isPolygon(int meshId) {
+            return face2poly != nullptr && (*polys)[(*face2poly)[meshId]].size() > 1;
+        }
+        void growFrom(std::priority_queue<Node, std::vector<Node>, CompareWeight> &pq, std::map<int, double> &dist) {
             // max spanning tree, prime algorithm
-            while (!pq.empty()) {
-                auto node = pq.top();
+            while (true) {
+                // pop out all meshes that is flatted or cannot be flatted in this island
+                while (!pq.empty() && (flattened.find(pq.top().meshId) != flattened.end() || !flattenPolygon(pq.top().parentMeshId, pq.top().meshId, pq.top().edge))) {
+                    pq.pop();
+                }
+                if (pq.empty()) break;
+                Node node = pq.top();
                 pq.pop();
-                Mesh* curMesh = meshes[node.meshId];
-                for(auto meshNedge: curMesh->nebMeshes) {
+                attach(node.parentMeshId, node.meshId);
+                pushNebMeshes(node.meshId, pq, dist);
+                for (Node &sibling: polygonNodes) {
+                    attach(sibling.parentMeshId, sibling.meshId);
+                    updateHinge(meshes[sibling.parentMeshId], meshes[sibling.meshId], sibling.edge);
+                    pushNebMeshes(sibling.meshId, pq, dist);
+                }
+            }
+        }
+        // flatten meshId and the rest of its coplanar polygon in one go, the polygon is
+        // checked against the grid along its outline. The placed siblings are left in polygonNodes.
+        bool flattenPolygon(int preMeshId, int meshId, Edge edge) {
+            polygonNodes.clear();
+            if (!flattenMesh(preMeshId, meshId, edge, flattened)) return false;
+            if (!isPolygon(meshId)) return true;
+
+            // flat position of every vertex of the polygon placed so far, the new mesh has to agree with them
+            Mesh* entry = meshes[meshId];
+            std::map<int, Eigen::Vector3d> polyPos;
+            for (int polyMeshId: (*polys)[(*face2poly)[meshId]]) {
+                if (flattened.find(polyMeshId) == flattened.end()) continue;
+                for (auto it: meshes[polyMeshId]->vid2fv) {
+                    polyPos[it.first] = it.second;
+                }
+            }
+            int entry3 = thirdVertex(entry, edge);
+            double tolerance = COPLANAR_CLOSE_TOLERANCE*(entry->vid2fv[edge.first]-entry->vid2fv[edge.second]).norm();
+            if (polyPos.find(entry3) != polyPos.end() && (polyPos[entry3]-entry->vid2fv[entry3]).norm() > tolerance) return false;
+            for (auto it: entry->vid2fv) {
+                polyPos[it.first] = it.second;
+            }
+
+            std::set<int> placed;
+            placed.insert(meshId);
+            std::queue<int> q;
+            q.push(meshId);
+            while (!q.empty()) {
+                Mesh* preMesh = meshes[q.front()];
+                q.pop();
+                for (auto meshNedge: preMesh->nebMeshes) {
                     int nebMeshId = meshNedge.first;
-                    auto edge = meshNedge.second;
-                    if (flattened.find(nebMeshId) == flattened.end() && edge2weight[edge] > dist[nebMeshId]) {
-                        dist[nebMeshId] = edge2weight[edge];
-                        pq.push(Node(edge2weight[edge], edge, curMesh->id, nebMeshId));
+                    Edge nebEdge = meshNedge.second;
+                    if (!samePolygon(preMesh->id, nebMeshId) || isForcedCut(nebEdge)) continue;
+                    if (meshes.find(nebMeshId) == meshes.end() || flattened.find(nebMeshId) != flattened.end() || placed.find(nebMeshId) != placed.end()) continue;
+                    // coplanar, so the mesh is simply unfolded to the other side of the edge
+                    Mesh* mesh = meshes[nebMeshId];
+                    int v3 = thirdVertex(mesh, nebEdge), pre3 = thirdVertex(preMesh, nebEdge);
+                    Eigen::Vector3d fv1Pos = preMesh->vid2fv[nebEdge.first], fv2Pos = preMesh->vid2fv[nebEdge.second];
+                    Eigen::Vector3d flat1, flat2;
+                    flatCandidates(nebMeshId, v3, nebEdge.first, nebEdge.second, fv1Pos, fv2Pos, flat1, flat2);
+                    Eigen::Vector3d dir = fv2Pos-fv1Pos;
+                    bool flip = dir.cross(flat1-fv1Pos).z()*dir.cross(preMesh->vid2fv[pre3]-fv1Pos).z() > 0.;
+                    Eigen::Vector3d fv3Pos = flip? flat2 : flat1;
+                    // a nearly flat fan around a vertex does not close exactly, the mesh closing it stays cut
+                    if (polyPos.find(v3) != polyPos.end() && (polyPos[v3]-fv3Pos).norm() > COPLANAR_CLOSE_TOLERANCE*dir.norm()) continue;
+                    polyPos[v3] = fv3Pos;
+                    mesh->vid2fv[nebEdge.first] = fv1Pos;
+                    mesh->vid2fv[nebEdge.second] = fv2Pos;
+                    mesh->vid2fv[v3] = fv3Pos;
+                    placed.insert(nebMeshId);
+                    polygonNodes.push_back(Node(0., nebEdge, preMesh->id, nebMeshId));
+                    q.push(nebMeshId);
+                }
+            }
+            return !polygonOverlap(polygonNodes);
+        }
+        int thirdVertex(Mesh* mesh, Edge edge) {
+            for (int vid: mesh->vids) {
+                if (vid != edge.first && vid != edge.second) return vid;
+            }
+            return -1;
+        }
+        // every mesh of the polygon is only tested against the grid cells it covers, and only its outline edges
+        // are tested for crossings
+        bool polygonOverlap(const std::vector<Node> &nodes) {
+            for (const Node &node: nodes) {
+                Mesh* mesh = meshes[node.meshId];
+                Eigen::Matrix3d curMeshfV = mesh->getFlatV();
+                Eigen::Vector3d curCenter = (curMeshfV.col(0)+curMeshfV.col(1)+curMeshfV.col(2))/3.;
+                std::set<int> nearMeshes = grid->getNearMeshes(curMeshfV.col(0), curMeshfV.col(1), curMeshfV.col(2));
+                for (int meshId: nearMeshes) {
+                    Eigen::Matrix3d meshfV = meshes[meshId]->getFlatV();
+                    if (isInside(curCenter, meshfV)) return true;
+                    if (isInside(meshfV.col(0), curMeshfV) || isInside(meshfV.col(1), curMeshfV) || isInside(meshfV.col(2), curMeshfV)) return true;
+                    for (int k = 0; k < 3; k++) {
+                        int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+                        Edge edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+                        if (isPolygonEdge(mesh, edge)) continue;
+                        if (lineCross(mesh->vid2fv[v1], mesh->vid2fv[v2], meshId)) return true;
                     }
                 }
-                // pop out all meshes that is flatted or cannot be flatted in this island
-                while (!pq.empty() && (flattened.find(pq.top().meshId) != flattened.end() || !flattenMesh(pq.top().parentMeshId, pq.top().meshId, pq.top().edge, flattened))) {
-                    pq.pop();
+            }
+            return false;
+        }
+        bool isPolygonEdge(Mesh* mesh, Edge edge) {
+            for (auto meshNedge: mesh->nebMeshes) {
+                if (meshNedge.second == edge && samePolygon(mesh->id, meshNedge.first)) return true;
+            }
+            return false;
+        }
+        // the flattened meshes of this island on every edge
+        std::map<Edge, std::vector<int>> flatEdges() {
+            std::map<Edge, std::vector<int>> edgeMeshes;
+            for (int meshId: flattened) {
+                Mesh* mesh = meshes[meshId];
+                for (int k = 0; k < 3; k++) {
+                    int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+                    edgeMeshes[v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1)].push_back(meshId);
                 }
-                if (!pq.empty()) {
-                    node = pq.top();
-                    flattened.insert(node.meshId);
-                    grid->addItem(meshes[node.meshId]);
-                    // build MST node connections
-                    Mesh* curMesh = meshes[node.meshId];
-                    Mesh* preMesh = meshes[node.parentMeshId];
-                    curMesh->parent = preMesh;
-                    preMesh->childs.push_back(curMesh);
+            }
+            return edgeMeshes;
+        }
+        // the mesh of this island joined to edge k of mesh in the flat layout, -1 if the edge is cut
+        int flatNeighbour(Mesh* mesh, int k, std::map<Edge, std::vector<int>> &edgeMeshes) {
+            int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+            Edge edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+            double tol = ESP*(mesh->vid2fv[v1]-mesh->vid2fv[v2]).norm();
+            for (int nebId: edgeMeshes[edge]) {
+                Mesh* neb = meshes[nebId];
+                if (nebId == mesh->id) continue;
+                if ((neb->vid2fv[v1]-mesh->vid2fv[v1]).norm() < tol && (neb->vid2fv[v2]-mesh->vid2fv[v2]).norm() < tol)
+                    return nebId;
+            }
+            return -1;
+        }
+        // mesh id and edge k of every cut edge of the island
+        std::vector<std::pair<int, int>> cutEdges() {
+            std::vector<std::pair<int, int>> cuts;
+            std::map<Edge, std::vector<int>> edgeMeshes = this->flatEdges();
+            for (int meshId: flattened) {
+                for (int k = 0; k < 3; k++) {
+                    if (flatNeighbour(meshes[meshId], k, edgeMeshes) < 0) cuts.push_back(std::make_pair(meshId, k));
                 }
             }
-
+            return cuts;
+        }
+        // closed loops of the cut edges around the island in flat positions. A vertex may sit on several
+        // places of the outline and the meshes may not share one winding, so a loop goes on with the cut edge
+        // of either direction that touches the place where the last one ended.
+        std::vector<std::vector<Eigen::Vector3d>> cutLoops() {
+            std::vector<std::pair<int, int>> ends;
+            std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> segments;
+            // the outer corners of a glue tab go between the ends of its edge
+            std::vector<std::vector<Eigen::Vector3d>> tabCorners;
+            std::map<std::pair<int, int>, int> edgeTabs;
+            for (int i = 0; i < tabs.size(); i++) {
+                edgeTabs[std::make_pair(tabs[i].meshId, tabs[i].k)] = i;
+            }
+            std::map<int, std::vector<int>> touching;
+            std::map<Edge, std::vector<int>> edgeMeshes = this->flatEdges();
             for (int meshId: flattened) {
-                meshFlattened[meshId] = true;
-                Eigen::Matrix3d flatV = meshes[meshId]->getFlatV();
-                this->fV.conservativeResize(4, fV.cols()+3);
-                int last = this->fV.cols();
-                this->fV.col(last-3) = to_4_point(flatV.col(0));
-                this->fV.col(last-2) = to_4_point(flatV.col(1));
-                this->fV.col(last-1) = to_4_point(flatV.col(2));
-                this->idx2meshId[last-3] = meshId;
+                Mesh* mesh = meshes[meshId];
+                for (int k = 0; k < 3; k++) {
+                    if (flatNeighbour(mesh, k, edgeMeshes) >= 0) continue;
+                    int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+                    touching[v1].push_back(ends.size());
+                    touching[v2].push_back(ends.size());
+                    ends.push_back(std::make_pair(v1, v2));
+                    segments.push_back(std::make_pair(mesh->vid2fv[v1], mesh->vid2fv[v2]));
+                    tabCorners.push_back(std::vector<Eigen::Vector3d>());
+                    auto tab = edgeTabs.find(std::make_pair(meshId, k));
+                    if (tab != edgeTabs.end()) {
+                        tabCorners.back().push_back(tabs[tab->second].cornerA);
+                        tabCorners.back().push_back(tabs[tab->second].cornerB);
+                    }
+                }
             }
-
-            // update flat position to VBO, compute bounding box
-            this->VAO.init();
-            this->VAO.bind();
-            this->VBO_P.init();
-            this->VBO_P.update(m_to_float(this->fV));
-
-            // init model fields
-            this->ModelMat = Eigen::MatrixXd::Identity(4,4);
-            this->T_to_ori = Eigen::MatrixXd::Identity(4,4);
-            this->barycenter = Eigen::Vector4d(0.0, 0.0, 0.0, 1.0);
-
-            // check tree
-            // Mesh* root = meshes.begin()->second;
-            // std::queue<Mesh*> q;
-            // q.push(root);
-            // while (!q.empty()) {
-            //     Mesh* cur = q.front();
-            //     q.pop();
-            //     for (Mesh* child: cur->childs) {
-            //         q.push(child);
-            //     }
-            // }
+            std::vector<std::vector<Eigen::Vector3d>> loops;
+            std::vector<bool> used(ends.size(), false);
+            for (int first = 0; first < ends.size(); first++) {
+                if (used[first]) continue;
+                used[first] = true;
+                std::vector<Eigen::Vector3d> loop(1, segments[first].first);
+                loop.insert(loop.end(), tabCorners[first].begin(), tabCorners[first].end());
+                int vid = ends[first].second;
+                Eigen::Vector3d pos = segments[first].second;
+                while (true) {
+                    int next = -1;
+                    bool reversed = false;
+                    double nextDist = DIST_MAX;
+                    for (int cand: touching[vid]) {
+                        if (used[cand]) continue;
+                        bool candReversed = ends[cand].first != vid;
+                        double dist = ((candReversed? segments[cand].second : segments[cand].first)-pos).norm();
+                        if (dist < nextDist) {
+                            next = cand;
+                            reversed = candReversed;
+                            nextDist = dist;
+                        }
+                    }
+                    // closed when the way back to the start is the only one left
+                    if (next < 0 || (vid == ends[first].first && (pos-loop[0]).norm() <= nextDist)) break;
+                    used[next] = true;
+                    loop.push_back(pos);
+                    if (reversed)
+                        loop.insert(loop.end(), tabCorners[next].rbegin(), tabCorners[next].rend());
+                    else
+                        loop.insert(loop.end(), tabCorners[next].begin(), tabCorners[next].end());
+                    vid = reversed? ends[next].first : ends[next].second;
+                    pos = reversed? segments[next].first : segments[next].second;
+                }
+                loops.push_back(loop);
+            }
+            return loops;
+        }
+        // the edges joining two meshes in the flat layout, once each and without the diagonals of coplanar
+        // polygons, and the bases of the glue tabs. A fold is a mountain when it bulges towards the viewer of
+        // the flat layout.
+        void foldLines(std::vector<Eigen::Vector3d> &mountains, std::vector<Eigen::Vector3d> &valleys) {
+            std::map<Edge, std::vector<int>> edgeMeshes = this->flatEdges();
+            for (int meshId: flattened) {
+                Mesh* mesh = meshes[meshId];
+                for (int k = 0; k < 3; k++) {
+                    int nebId = flatNeighbour(mesh, k, edgeMeshes);
+                    if (nebId < meshId || samePolygon(meshId, nebId)) continue;
+                    Mesh* neb = meshes[nebId];
+                    int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+                    int w = neb->vids[0]+neb->vids[1]+neb->vids[2]-v1-v2;
+                    std::vector<Eigen::Vector3d> &lines = isMountain(mesh, k, neb->vid2v[w])? mountains : valleys;
+                    lines.push_back(mesh->vid2fv[v1]);
+                    lines.push_back(mesh->vid2fv[v2]);
+                }
+            }
+            // a tab folds under the mesh it is glued to, like the edge would fold
+            for (auto &tab: tabs) {
+                Mesh* mesh = meshes[tab.meshId];
+                std::vector<Eigen::Vector3d> &lines = tab.mountain? mountains : valleys;
+                lines.push_back(mesh->vid2fv[mesh->vids[tab.k]]);
+                lines.push_back(mesh->vid2fv[mesh->vids[(tab.k+1)%3]]);
+            }
+        }
+        // whether the fold on edge k of the mesh is a mountain seen on the flat layout, apex is the 3d
+        // position of the third vertex of the mesh on the other side of the edge
+        bool isMountain(Mesh* mesh, int k, Eigen::Vector3d apex) {
+            int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3], v3 = mesh->vids[(k+2)%3];
+            // convex in 3d if the neighbour falls behind the outward side of the mesh
+            Eigen::Vector3d normal = (mesh->vid2v[v2]-mesh->vid2v[v1]).cross(mesh->vid2v[v3]-mesh->vid2v[v1]);
+            bool convex = normal.dot(apex-mesh->vid2v[v1]) < 0.;
+            // the outward side faces the viewer if the flat mesh keeps its winding
+            Eigen::Vector3d flatNormal = (mesh->vid2fv[v2]-mesh->vid2fv[v1]).cross(mesh->vid2fv[v3]-mesh->vid2fv[v1]);
+            return convex == (flatNormal.z() > 0.);
+        }
+        // the outline of a glue tab of the given height on edge k of the mesh: the ends of the edge, then the
+        // outer corners from the side of vertex k+1. The sides of the tab lean in at 45 degrees.
+        std::vector<Eigen::Vector2d> tabOutline(Mesh* mesh, int k, double height) {
+            Eigen::Vector2d a = mesh->vid2fv[mesh->vids[k]].head<2>(), b = mesh->vid2fv[mesh->vids[(k+1)%3]].head<2>();
+            Eigen::Vector2d c = mesh->vid2fv[mesh->vids[(k+2)%3]].head<2>();
+            Eigen::Vector2d along = (b-a).normalized();
+            Eigen::Vector2d out(-along.y(), along.x());
+            if (out.dot(c-a) > 0.) out = -out;
+            std::vector<Eigen::Vector2d> tab;
+            tab.push_back(a);
+            tab.push_back(b);
+            tab.push_back(b+height*(out-along));
+            tab.push_back(a+height*(out+along));
+            return tab;
+        }
+        // the highest glue tab up to height on edge k of the mesh that does not overlap the faces of the island,
+        // the height is halved up to GLUE_TAB_TRIES times. The faces come from one grid query for the highest
+        // tab, the lower ones lie within it. Returns 0 if no tab fits.
+        double tabFit(Mesh* mesh, int k, double height) {
+            std::vector<Eigen::Vector2d> tab = tabOutline(mesh, k, height);
+            Eigen::Vector2d lo = tab[0].cwiseMin(tab[1]).cwiseMin(tab[2]).cwiseMin(tab[3]);
+            Eigen::Vector2d hi = tab[0].cwiseMax(tab[1]).cwiseMax(tab[2]).cwiseMax(tab[3]);
+            std::vector<std::vector<Eigen::Vector2d>> faces;
+            for (int meshId: grid->getNearMeshes(Eigen::Vector3d(lo.x(), lo.y(), 0.), Eigen::Vector3d(hi.x(), hi.y(), 0.), Eigen::Vector3d(hi.x(), hi.y(), 0.))) {
+                Eigen::Matrix3d meshfV = meshes[meshId]->getFlatV();
+                std::vector<Eigen::Vector2d> face;
+                for (int i = 0; i < 3; i++) {
+                    face.push_back(meshfV.col(i).head<2>());
+                }
+                faces.push_back(face);
+            }
+            for (int i = 0; i < GLUE_TAB_TRIES; i++, height /= 2.) {
+                tab = tabOutline(mesh, k, height);
+                bool clear = true;
+                for (auto &face: faces) {
+                    if (convex_overlap_2d(tab, face)) {
+                        clear = false;
+                        break;
+                    }
+                }
+                if (clear) return height;
+            }
+            return 0.;
+        }
+        // place glue tabs on edge k of the meshes, each at most as high as its height. A tab is halved until
+        // it clears the tabs placed before it, found through a grid like the faces, or left out.
+        void placeTabs(const std::vector<GlueTab> &wanted, const std::vector<double> &heights) {
+            this->tabs.clear();
+            Grid tabGrid(grid->sizex, grid->sizey);
+            std::vector<std::vector<Eigen::Vector2d>> placed;
+            for (int t = 0; t < wanted.size(); t++) {
+                Mesh* mesh = meshes[wanted[t].meshId];
+                int k = wanted[t].k;
+                double height = heights[t];
+                for (int i = 0; i < GLUE_TAB_TRIES; i++, height /= 2.) {
+                    std::vector<Eigen::Vector2d> tab = tabOutline(mesh, k, height);
+                    Eigen::MatrixXd P = Eigen::MatrixXd::Zero(3, 4);
+                    for (int j = 0; j < 4; j++) {
+                        P.col(j).head<2>() = tab[j];
+                    }
+                    Eigen::MatrixXd box = get_bounding_box_2d(P);
+                    bool clear = true;
+                    for (int other: tabGrid.getNearMeshes(Eigen::Vector3d(box(0, 0), box(1, 0), 0.), Eigen::Vector3d(box(0, 1), box(1, 1), 0.), Eigen::Vector3d(box(0, 1), box(1, 1), 0.))) {
+                        if (convex_overlap_2d(tab, placed[other])) {
+                            clear = false;
+                            break;
+                        }
+                    }
+                    if (!clear) continue;
+                    tabGrid.addBox(placed.size(), box);
+                    placed.push_back(tab);
+                    double z = mesh->vid2fv[mesh->vids[k]].z();
+                    this->tabs.push_back(GlueTab(wanted[t].meshId, k, Eigen::Vector3d(tab[3].x(), tab[3].y(), z), Eigen::Vector3d(tab[2].x(), tab[2].y(), z), wanted[t].mountain));
+                    break;
+                }
+            }
+        }
+        // the flat triangles of the island and of its glue tabs, the room the island takes on paper
+        Eigen::MatrixXd footprint() {
+            Eigen::MatrixXd P(4, this->fV.cols()+6*this->tabs.size());
+            P.leftCols(this->fV.cols()) = this->fV;
+            int last = this->fV.cols();
+            for (auto &tab: tabs) {
+                Mesh* mesh = meshes[tab.meshId];
+                Eigen::Vector3d a = mesh->vid2fv[mesh->vids[tab.k]], b = mesh->vid2fv[mesh->vids[(tab.k+1)%3]];
+                P.col(last) = to_4_point(a); P.col(last+1) = to_4_point(b); P.col(last+2) = to_4_point(tab.cornerB);
+                P.col(last+3) = to_4_point(a); P.col(last+4) = to_4_point(tab.cornerB); P.col(last+5) = to_4_point(tab.cornerA);
+                last += 6;
+            }
+            return P;
+        }
+        void attach(int preMeshId, int meshId) {
+            flattened.insert(meshId);
+            grid->addItem(meshes[meshId]);
+            // build MST node connections
+            Mesh* curMesh = meshes[meshId];
+            Mesh* preMesh = meshes[preMeshId];
+            curMesh->parent = preMesh;
+            preMesh->childs.push_back(curMesh);
+        }
+        // remove the subtree rooted at root from this island, its meshes are handed back to the caller
+        std::vector<Mesh*> detachSubtree(Mesh* root) {
+            if (root->parent != nullptr) {
+                std::vector<Mesh*> &siblings = root->parent->childs;
+                siblings.erase(std::remove(siblings.begin(), siblings.end(), root), siblings.end());
+            }
+            std::vector<Mesh*> detached;
+            std::queue<Mesh*> q;
+            q.push(root);
+            while (!q.empty()) {
+                Mesh* cur = q.front();
+                q.pop();
+                detached.push_back(cur);
+                for (Mesh* child: cur->childs) {
+                    q.push(child);
+                }
+            }
+            for (Mesh* mesh: detached) {
+                grid->removeItem(mesh);
+                flattened.erase(mesh->id);
+                meshes.erase(mesh->id);
+                mesh->parent = nullptr;
+                mesh->childs.clear();
+                mesh->accR = Eigen::MatrixXd::Identity(4,4);
+                mesh->animeM = Eigen::MatrixXd::Identity(4,4);
+            }
+            return detached;
+        }
+        // reattach detached meshes to this island through their shared edges, return the ones that do not fit
+        std::vector<Mesh*> regrow(std::vector<Mesh*> pool) {
+            std::priority_queue<Node, std::vector<Node>, CompareWeight> pq;
+            std::map<int, double> dist;
+            for (Mesh* mesh: pool) {
+                meshes[mesh->id] = mesh;
+            }
+            for (Mesh* mesh: pool) {
+                for (auto meshNedge: mesh->nebMeshes) {
+                    int nebMeshId = meshNedge.first;
+                    auto edge = meshNedge.second;
+                    if (flattened.find(nebMeshId) == flattened.end() || isForcedCut(edge)) continue;
+                    double weight = edgeWeight(edge);
+                    if (weight > dist[mesh->id]) {
+                        dist[mesh->id] = weight;
+                        pq.push(Node(weight, edge, nebMeshId, mesh->id));
+                    }
+                }
+            }
+            growFrom(pq, dist);
+            return takeUnflattened(pool);
+        }
+        // fold mesh onto preMeshId through edge, then grow the rest of pool from it
+        bool attachThrough(int preMeshId, Mesh* mesh, Edge edge, std::vector<Mesh*> &pool) {
+            for (Mesh* m: pool) {
+                meshes[m->id] = m;
+            }
+            if (!flattenMesh(preMeshId, mesh->id, edge, flattened)) {
+                takeUnflattened(pool);
+                return false;
+            }
+            std::priority_queue<Node, std::vector<Node>, CompareWeight> pq;
+            std::map<int, double> dist;
+            attach(preMeshId, mesh->id);
+            dist[mesh->id] = DIST_MAX;
+            pushNebMeshes(mesh->id, pq, dist);
+            growFrom(pq, dist);
+            pool = takeUnflattened(pool);
+            return true;
+        }
+        std::vector<Mesh*> takeUnflattened(std::vector<Mesh*> &pool) {
+            std::vector<Mesh*> left;
+            for (Mesh* mesh: pool) {
+                if (flattened.find(mesh->id) == flattened.end()) {
+                    meshes.erase(mesh->id);
+                    left.push_back(mesh);
+                }
+            }
+            return left;
+        }
+        bool isAncestor(Mesh* ancestor, Mesh* mesh) {
+            for (Mesh* cur = mesh; cur != nullptr; cur = cur->parent) {
+                if (cur == ancestor) return true;
+            }
+            return false;
+        }
+        int subtreeSize(Mesh* root) {
+            int size = 0;
+            std::queue<Mesh*> q;
+            q.push(root);
+            while (!q.empty()) {
+                Mesh* cur = q.front();
+                q.pop();
+                size++;
+                for (Mesh* child: cur->childs) {
+                    q.push(child);
+                }
+            }
+            return size;
         }
         
         bool flattenMesh(int preMeshId, int meshId, std::pair<int, int> edge, std::set<int> &flattened) {
@@ -617,6 +1175,13 @@ class FlattenObject {
             mesh->vid2fv[fv2] = preMesh->vid2fv[fv2];
             mesh->vid2fv[v3] = fv3Pos;
 
+            this->updateHinge(preMesh, mesh, edge);
+            return true;
+        }
+        // compute how mesh rotates around the edge shared with its parent preMesh
+        void updateHinge(Mesh* preMesh, Mesh* mesh, std::pair<int, int> edge) {
+            int fv1 = edge.first, fv2 = edge.second;
+
             // compute rotate angle
             Eigen::Vector3d curh = mesh->getH(edge).normalized();
             Eigen::Vector3d preh = preMesh->getH(edge).normalized();
@@ -655,27 +1220,13 @@ class FlattenObject {
             mesh->rotDot = rotDot;
 
             // std::cout << rotAngle << std::endl;
-
-            return true;
         }
 
         // compute the flat position of v3 according to the flat position of v1 and v2
         // check overlap
         bool flattenVertex(int meshId, int v3, int v1, int v2, Eigen::Vector3d fv1Pos, Eigen::Vector3d fv2Pos, Eigen::Vector3d &fv3Pos, std::set<int> &flattened) {
-            Mesh* mesh = meshes[meshId];
             Eigen::Vector3d flat1, flat2;
-            
-            // use get H to compute fH
-            Eigen::Vector3d aixs = (mesh->vid2v[v1]-mesh->vid2v[v2]).normalized();
-            Eigen::Vector3d vec = mesh->vid2v[v3]-mesh->vid2v[v2];
-            double len = vec.dot(aixs);
-            Eigen::Vector3d parallel = len*aixs;
-            Eigen::Vector3d hvec = vec-parallel;
-            Eigen::Vector3d faixs = (fv1Pos - fv2Pos).normalized();
-            Eigen::Vector3d fH = fv2Pos + len * faixs;
-            Eigen::Vector3d flatDir = Eigen::Vector3d(-faixs.y(), faixs.x(), 0.).normalized();
-            flat1 = fH + hvec.norm() * flatDir;
-            flat2 = fH + hvec.norm() * (-flatDir);
+            flatCandidates(meshId, v3, v1, v2, fv1Pos, fv2Pos, flat1, flat2);
 
             // check overlap
             bool canFlat = false;
@@ -692,6 +1243,22 @@ class FlattenObject {
 
             return canFlat;
         }
+        // the two flat positions of v3, one on each side of the flat edge
+        void flatCandidates(int meshId, int v3, int v1, int v2, Eigen::Vector3d fv1Pos, Eigen::Vector3d fv2Pos, Eigen::Vector3d &flat1, Eigen::Vector3d &flat2) {
+            Mesh* mesh = meshes[meshId];
+
+            // use get H to compute fH
+            Eigen::Vector3d aixs = (mesh->vid2v[v1]-mesh->vid2v[v2]).normalized();
+            Eigen::Vector3d vec = mesh->vid2v[v3]-mesh->vid2v[v2];
+            double len = vec.dot(aixs);
+            Eigen::Vector3d parallel = len*aixs;
+            Eigen::Vector3d hvec = vec-parallel;
+            Eigen::Vector3d faixs = (fv1Pos - fv2Pos).normalized();
+            Eigen::Vector3d fH = fv2Pos + len * faixs;
+            Eigen::Vector3d flatDir = Eigen::Vector3d(-faixs.y(), faixs.x(), 0.).normalized();
+            flat1 = fH + hvec.norm() * flatDir;
+            flat2 = fH + hvec.norm() * (-flatDir);
+        }
 
         bool overlap(Eigen::Vector3d flatPos, Eigen::Vector3d fv1Pos, Eigen::Vector3d fv2Pos, std::set<int> &flattened) {
             // check if any vertices of a flat Triangle inside the other flat Triangle
@@ -719,6 +1286,85 @@ class FlattenObject {
             }
             return false;
         }
+        // full triangle against triangle test, used when a whole island is moved rather than grown
+        bool triangleOverlap(Eigen::Vector3d A, Eigen::Vector3d B, Eigen::Vector3d C) {
+            std::set<int> nearMeshes = grid->getNearMeshes(A, B, C);
+            Eigen::Matrix3d curMeshfV;
+            curMeshfV << A, B, C;
+            Eigen::Vector3d curCenter = (A+B+C)/3.;
+            for (int meshId: nearMeshes) {
+                Eigen::Matrix3d meshfV = meshes[meshId]->getFlatV();
+                if (isInside(A, meshfV) || isInside(B, meshfV) || isInside(C, meshfV)) return true;
+                if (isInside(curCenter, meshfV)) return true;
+                if (isInside(meshfV.col(0), curMeshfV) || isInside(meshfV.col(1), curMeshfV) || isInside(meshfV.col(2), curMeshfV)) return true;
+                Eigen::Vector3d center = (meshfV.col(0)+meshfV.col(1)+meshfV.col(2))/3.;
+                if (isInside(center, curMeshfV)) return true;
+                if (lineCross(A, B, meshId) || lineCross(B, C, meshId) || lineCross(A, C, meshId)) return true;
+            }
+            return false;
+        }
+        // rigidly move the other island so that its mesh folds onto preMeshId through edge, then take over its meshes
+        bool absorb(FlattenObject &other, int preMeshId, Mesh* mesh, Edge edge) {
+            Mesh* preMesh = meshes[preMeshId];
+            Eigen::Vector3d pa1 = preMesh->vid2fv[edge.first], pa2 = preMesh->vid2fv[edge.second];
+            Eigen::Vector3d pb1 = mesh->vid2fv[edge.first], pb2 = mesh->vid2fv[edge.second];
+            double theta = atan2(pa2.y()-pa1.y(), pa2.x()-pa1.x()) - atan2(pb2.y()-pb1.y(), pb2.x()-pb1.x());
+            Eigen::Matrix3d R = Eigen::Matrix3d::Identity();
+            R(0, 0) = cos(theta); R(0, 1) = -sin(theta);
+            R(1, 0) = sin(theta); R(1, 1) = cos(theta);
+            Eigen::Vector3d t = pa1 - R*pb1;
+
+            // the moved mesh has to land on the other side of the edge
+            Eigen::Vector3d dir = pa2-pa1;
+            Eigen::Vector3d preSide, curSide;
+            for (int vid: preMesh->vids) {
+                if (vid != edge.first && vid != edge.second) preSide = preMesh->vid2fv[vid]-pa1;
+            }
+            for (int vid: mesh->vids) {
+                if (vid != edge.first && vid != edge.second) curSide = R*mesh->vid2fv[vid]+t-pa1;
+            }
+            if (dir.cross(preSide).z()*dir.cross(curSide).z() >= 0.) return false;
+
+            for (int meshId: other.flattened) {
+                Mesh* m = other.meshes[meshId];
+                Eigen::Vector3d A = R*m->vid2fv[m->vids[0]]+t, B = R*m->vid2fv[m->vids[1]]+t, C = R*m->vid2fv[m->vids[2]]+t;
+                if (triangleOverlap(A, B, C)) return false;
+            }
+
+            // move the meshes over and reroot their tree at mesh
+            for (int meshId: other.flattened) {
+                Mesh* m = other.meshes[meshId];
+                for (int vid: m->vids) {
+                    m->vid2fv[vid] = R*m->vid2fv[vid]+t;
+                }
+                meshes[meshId] = m;
+            }
+            Mesh* prev = preMesh;
+            Edge prevEdge = edge;
+            Mesh* cur = mesh;
+            while (cur != nullptr) {
+                Mesh* next = cur->parent;
+                Edge nextEdge = cur->rotEdge;
+                if (next != nullptr) {
+                    next->childs.erase(std::remove(next->childs.begin(), next->childs.end(), cur), next->childs.end());
+                }
+                cur->parent = prev;
+                cur->rotEdge = prevEdge;
+                prev->childs.push_back(cur);
+                prev = cur;
+                prevEdge = nextEdge;
+                cur = next;
+            }
+            for (int meshId: other.flattened) {
+                Mesh* m = meshes[meshId];
+                this->updateHinge(m->parent, m, m->rotEdge);
+                flattened.insert(meshId);
+                grid->addItem(m);
+            }
+            other.meshes.clear();
+            other.flattened.clear();
+            return true;
+        }
         bool lineCross(Eigen::Vector3d a, Eigen::Vector3d b, int meshId) {
             Mesh* mesh = meshes[meshId];
             int ov1, ov2, ov3;
@@ -762,6 +1408,25 @@ class FlattenObject {
 
             return x(0)-0. > ESP && x(1)-0. > ESP && x(2)-0. > ESP;
         }
+        // pairs of meshes of this island that overlap in the flat layout
+        std::vector<std::pair<int, int>> certify() {
+            Eigen::MatrixXd triangles(6, this->fV.cols()/3);
+            std::vector<int> triangle2meshId(triangles.cols());
+            for (auto it: this->idx2meshId) {
+                int t = it.first/3;
+                for (int k = 0; k < 3; k++) {
+                    triangles(2*k, t) = this->fV(0, it.first+k);
+                    triangles(2*k+1, t) = this->fV(1, it.first+k);
+                }
+                triangle2meshId[t] = it.second;
+            }
+            std::set<std::pair<int, int>> pairs;
+            for (auto overlap: find_triangle_overlaps(triangles)) {
+                int a = triangle2meshId[overlap.first], b = triangle2meshId[overlap.second];
+                pairs.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+            return std::vector<std::pair<int, int>>(pairs.begin(), pairs.end());
+        }
         void translate(Eigen::Vector4d delta) {
             Eigen::MatrixXd T = Eigen::MatrixXd::Identity(4, 4);
             T.col(3)(0) = delta(0); T.col(3)(1) = delta(1); T.col(3)(2) = delta(2);
@@ -794,28 +1459,47 @@ class FlattenObject {
                 this->ModelMat = this->ModelMat*M;
             }
         }
-        std::string export_svg(Camera *camera) {
-            std::stringstream ss;
-            for (int i = 0; i < this->fV.cols(); i += 3) {
-                Eigen::MatrixXd mesh_fV(4, 3);
-                mesh_fV.col(0) = fV.col(i);
-                mesh_fV.col(1) = fV.col(i+1);
-                mesh_fV.col(2) = fV.col(i+2);
-                
-                mesh_fV = camera->get_project_mat()*camera->flatViewMat*ModelMat*mesh_fV;
-
-                std::string svg_str = get_tri_g_template();
-                std::string ax = std::to_string(mesh_fV.col(0).x()), ay = std::to_string(mesh_fV.col(0).y());
-                std::string bx = std::to_string(mesh_fV.col(1).x()), by = std::to_string(mesh_fV.col(1).y());
-                std::string cx = std::to_string(mesh_fV.col(2).x()), cy = std::to_string(mesh_fV.col(2).y());
-                svg_str = replace_all(svg_str, "$AX", ax); svg_str = replace_all(svg_str, "$AY", ay);
-                svg_str = replace_all(svg_str, "$BX", bx); svg_str = replace_all(svg_str, "$BY", by);
-                svg_str = replace_all(svg_str, "$CX", cx); svg_str = replace_all(svg_str, "$CY", cy);
-
-                ss << svg_str << std::endl;
+        // write the island to out as its cut outline and its fold lines, M takes the flat vertexes to the
+        // coordinates of the writer, an SvgWriter, a PdfContent or CutPaths
+        template <typename Writer>
+        void write_net(Writer &out, const Eigen::MatrixXd &M) {
+            std::vector<std::vector<Eigen::Vector2d>> loops;
+            for (auto loop: this->cutLoops()) {
+                loops.push_back(std::vector<Eigen::Vector2d>());
+                for (auto &v: loop) {
+                    loops.back().push_back((M*to_4_point(v)).head<2>());
+                }
             }
-            std::string svg_str = ss.str();
-            return svg_str;
+            out.outline(loops);
+            std::vector<Eigen::Vector3d> folds[2];
+            this->foldLines(folds[0], folds[1]);
+            for (int f = 0; f < 2; f++) {
+                std::vector<Eigen::Vector2d> segments;
+                for (auto &v: folds[f]) {
+                    segments.push_back((M*to_4_point(v)).head<2>());
+                }
+                out.folds(segments, SVG_MOUNTAIN_VALLEY? (f == 0? "mountain" : "valley") : "fold");
+            }
+        }
+        // write the glue numbers of the island to out shifted by firstLabel, they are printed but not cut
+        template <typename Writer>
+        void write_labels(Writer &out, const Eigen::MatrixXd &M, int firstLabel) {
+            // the glue labels at the edge midpoints, pushed towards the third vertex of their mesh
+            std::vector<Eigen::Vector2d> points, inward;
+            std::vector<int> numbers;
+            for (auto &glue: this->glueEdges) {
+                if (glue(0) < 0) continue;
+                Mesh* mesh = meshes[glue(1)];
+                int v1 = mesh->vids[glue(2)], v2 = mesh->vids[(glue(2)+1)%3], v3 = mesh->vids[(glue(2)+2)%3];
+                Eigen::Vector2d a = (M*to_4_point(mesh->vid2fv[v1])).head<2>();
+                Eigen::Vector2d b = (M*to_4_point(mesh->vid2fv[v2])).head<2>();
+                Eigen::Vector2d c = (M*to_4_point(mesh->vid2fv[v3])).head<2>();
+                Eigen::Vector2d normal = Eigen::Vector2d(a.y()-b.y(), b.x()-a.x()).normalized();
+                points.push_back((a+b)/2.);
+                inward.push_back(normal.dot(c-a) < 0? Eigen::Vector2d(-normal) : normal);
+                numbers.push_back(firstLabel+glue(0));
+            }
+            out.labels(points, inward, numbers);
         }
         void adjustSize(Eigen::MatrixXd boundingBox) {
             double maxx = boundingBox.col(1)(0), maxy = boundingBox.col(1)(1);
@@ -838,6 +1522,7 @@ class _3dObject {
     public:
         Eigen::MatrixXd box;
         Eigen::MatrixXd ModelMat;
+        FloatMat4 ModelMatF;
         Eigen::MatrixXd ModelMat_T;
         Eigen::MatrixXd Adjust_Mat;
         Eigen::MatrixXd T_to_ori;
@@ -846,6 +1531,8 @@ class _3dObject {
         Eigen::MatrixXd V;
         Eigen::MatrixXd C;
         Eigen::MatrixXd Normals;
+        // vertex positions without the homogeneous row, shared by all islands
+        Eigen::MatrixXd V3;
 
         int render_mode;
         double r, s, tx, ty;
@@ -853,6 +1540,37 @@ class _3dObject {
         std::vector<FlattenObject> flattenObjs;
         std::set<int> selectedMeshes;
 
+        // user edits of the net, edges are sorted vertex id pairs
+        std::set<Edge> forcedCuts;
+        std::set<Edge> forcedFolds;
+        std::map<Edge, std::vector<int>> edge2faces;
+        std::vector<int> face2island;
+        // glue labels of the islands, numbered from 1
+        int labelCnt = 0;
+        // edge-connected coplanar faces merged into planar polygons
+        std::vector<int> face2poly;
+        std::vector<std::vector<int>> polys;
+        int pickedMeshId;
+        Edge pickedEdge;
+        // how the islands are laid out on paper, LAYOUT_PACK, LAYOUT_NEST or LAYOUT_PAGES
+        int layoutMode;
+        // paginated layout: sheet size, pages to fit the model on or 0 for a fixed scale,
+        // millimetres per model unit, page count and pages per row
+        int paper;
+        int pageBudget;
+        double printScale;
+        int pageCnt, pageCols;
+        // width and height of the paper in model units and the matrix taking its coordinates to the window
+        Eigen::Vector2d paperSize;
+        Eigen::MatrixXd paperToWindow;
+
+        // coarse copy unfolded at once while the full net is computed on unfoldThread,
+        // the island state of this object belongs to the worker as long as unfolding is set
+        _3dObject* proxy = nullptr;
+        std::thread unfoldThread;
+        std::atomic<bool> unfoldDone;
+        bool unfolding = false;
+
         std::vector<std::vector<Mesh*>> edges;
         std::vector<Mesh*> meshes;
 
@@ -861,31 +1579,55 @@ class _3dObject {
         VertexBufferObject VBO_C;
         VertexBufferObject VBO_N;
         IndexBufferObject IBO_IDX;
+        // colour of every face in the 3d view, red when it is selected
+        TextureBufferObject TBO_S;
 
         _3dObject(){}
         _3dObject(std::string off_path, int color_idx) {
+            this->pickedMeshId = -1;
+            this->layoutMode = LAYOUT_PACK;
+            this->paper = PAPER_A4;
+            this->pageBudget = 0;
+            this->pageCnt = 0;
             //load from off file
             Eigen::MatrixXd V, C;
             Eigen::VectorXi IDX;
             loadMeshfromOFF(off_path, V, C, IDX);
-            C = Eigen::MatrixXd(3, V.cols());
-            // int color_idx = rand() % colors.size();
-            Eigen::Vector3i color = colors[color_idx];
-            for (int i = 0; i < V.cols(); i++) {
-                C.col(i) = color.cast<double>();
+            // dense scans are simplified before a Mesh is made for every face
+            decimate_mesh(V, C, IDX, DECIMATE_TARGET_FACES, DECIMATE_MAX_ERROR);
+            // the colours of a COFF file are kept, the others get the palette colour
+            if (C.cols() != V.cols()) {
+                C = Eigen::MatrixXd(3, V.cols());
+                // int color_idx = rand() % colors.size();
+                Eigen::Vector3i color = colors[color_idx];
+                for (int i = 0; i < V.cols(); i++) {
+                    C.col(i) = color.cast<double>();
+                }
             }
             //compute the bouncing box
             box = get_bounding_box(V);
             //create class Mesh for each mech
             this->initial(V, C, IDX, box);
         }
+        // proxy of another object, it is only unfolded and never drawn in 3d so no buffers are made
+        _3dObject(const Eigen::MatrixXd &V, const Eigen::VectorXi &IDX) {
+            this->pickedMeshId = -1;
+            this->layoutMode = LAYOUT_PACK;
+            this->paper = PAPER_A4;
+            this->pageBudget = 0;
+            this->pageCnt = 0;
+            this->box = get_bounding_box(V);
+            this->initMeshes(V, IDX, this->box);
+        }
+        ~_3dObject() {
+            if (this->unfoldThread.joinable()) this->unfoldThread.join();
+            delete this->proxy;
+        }
         void initial(Eigen::MatrixXd V, Eigen::MatrixXd C, Eigen::VectorXi IDX, Eigen::MatrixXd bounding_box) {
             // make sure it is a point
             for (int i = 0; i < V.cols(); i++) {
                 V.col(i)(3) = 1.0;
             }
-            this->IDX = IDX;
-            this->V = V;
             this->C = C;
 
             // Create a VAO
@@ -899,6 +1641,10 @@ class _3dObject {
             this->VBO_N.init();
             this->IBO_IDX.init();
             this->IBO_IDX.update(IDX);
+            this->TBO_S.init();
+            Eigen::MatrixXf faceColors(4, IDX.rows()/3);
+            faceColors.colwise() = Eigen::Vector4f(WHITE.x()/255.f, WHITE.y()/255.f, WHITE.z()/255.f, 1.f);
+            this->TBO_S.update(faceColors);
 
             this->ModelMat = Eigen::MatrixXd::Identity(4,4);
             this->ModelMat_T = Eigen::MatrixXd::Identity(4,4);
@@ -914,21 +1660,7 @@ class _3dObject {
             // Adjust size
             this->initial_adjust(bounding_box);
 
-            // initial edges
-            for (int i = 0; i < V.cols(); i++) {
-                this->edges.push_back(std::vector<Mesh*>());
-            }
-            std::cout << "start generating Meshs" << std::endl;
-            for (int i = 0; i < IDX.rows(); i+=3) {
-                int a = IDX(i), b = IDX(i+1), c = IDX(i+2);
-                Eigen::MatrixXd Vblock(4, 3);
-                Vblock << V.col(a), V.col(b), V.col(c);
-                auto mesh = new Mesh(Vblock, bounding_box);
-                this->meshes.push_back(mesh);
-                this->edges[a].push_back(mesh);
-                this->edges[b].push_back(mesh);
-                this->edges[c].push_back(mesh);
-            }
+            this->initMeshes(V, IDX, bounding_box);
 
             // Compute normlas for each vertex
             if (this->edges.size() != V.cols()) {
@@ -953,17 +1685,47 @@ class _3dObject {
             // this->flattenObjs.resize(10);
             this->flatten();
         }
+        void initMeshes(const Eigen::MatrixXd &V, const Eigen::VectorXi &IDX, const Eigen::MatrixXd &bounding_box) {
+            this->IDX = IDX;
+            this->V = V;
+            this->V3 = V.topRows(3);
+
+            // initial edges
+            for (int i = 0; i < V.cols(); i++) {
+                this->edges.push_back(std::vector<Mesh*>());
+            }
+            std::cout << "start generating Meshs" << std::endl;
+            for (int i = 0; i < IDX.rows(); i+=3) {
+                int a = IDX(i), b = IDX(i+1), c = IDX(i+2);
+                Eigen::MatrixXd Vblock(4, 3);
+                Vblock << V.col(a), V.col(b), V.col(c);
+                auto mesh = new Mesh(Vblock, bounding_box);
+                this->meshes.push_back(mesh);
+                this->edges[a].push_back(mesh);
+                this->edges[b].push_back(mesh);
+                this->edges[c].push_back(mesh);
+                this->addEdge(a, b, i/3);
+                this->addEdge(b, c, i/3);
+                this->addEdge(a, c, i/3);
+            }
+        }
+        void addEdge(int v1, int v2, int meshId) {
+            auto edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+            this->edge2faces[edge].push_back(meshId);
+        }
         void initial_adjust(Eigen::MatrixXd bounding_box) {
             double maxx = bounding_box.col(1)(0), maxy = bounding_box.col(1)(1), maxz = bounding_box.col(1)(2);
             double minx = bounding_box.col(0)(0), miny = bounding_box.col(0)(1), minz = bounding_box.col(0)(2);
             double scale_factor = fmin(1.0/(maxx-minx), fmin(1.0/(maxy-miny), 1.0/(maxz-minz)));
             this->scale(scale_factor);
         }
-        bool hit(Eigen::Vector4d ray_origin, Eigen::Vector4d ray_direction, double &dist) {
+        bool hit(Eigen::Vector4d ray_origin, Eigen::Vector4d ray_direction, double &dist, bool pickEdge = false) {
 
             bool intersected = false;
             int cnt = 0;
             int selectedMeshId;
+            Eigen::MatrixXd selectedV;
+            Eigen::Vector4d selectedPoint;
             for (auto mesh : this->meshes) {
                 Eigen::Vector4d intersection;
                 Eigen::MatrixXd mesh_V(4,3);
@@ -983,19 +1745,42 @@ class _3dObject {
                     double curDist = (intersection-ray_origin).norm();
                     if (curDist < dist) {
                         selectedMeshId = cnt;
+                        selectedV = mesh_V;
+                        selectedPoint = intersection;
                         dist = curDist;
                     }
                 }
                 cnt++;
             }
-            if (intersected) {
+            if (intersected && pickEdge) {
+                // pick the edge of the hitted mesh closest to the hit point
+                double minDist = DIST_MAX;
+                for (int k = 0; k < 3; k++) {
+                    int v1 = this->IDX(selectedMeshId*3+k), v2 = this->IDX(selectedMeshId*3+(k+1)%3);
+                    double edgeDist = point_segment_dist(to_3(selectedPoint), to_3(selectedV.col(k)), to_3(selectedV.col((k+1)%3)));
+                    if (edgeDist < minDist) {
+                        minDist = edgeDist;
+                        this->pickedEdge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+                    }
+                }
+                this->pickedMeshId = selectedMeshId;
+            }
+            else if (intersected) {
                 if (this->selectedMeshes.find(selectedMeshId) != selectedMeshes.end())
                     this->selectedMeshes.erase(selectedMeshId);
                 else
                     this->selectedMeshes.insert(selectedMeshId);
+                this->updateSelection(selectedMeshId);
             }
             return intersected;
         }
+        // upload the colour of a face whose selection changed, the other faces are left as they are
+        void updateSelection(int meshId) {
+            Eigen::Vector3i color = this->selectedMeshes.find(meshId) != this->selectedMeshes.end()? RED : WHITE;
+            Eigen::MatrixXf texel(4, 1);
+            texel << color.x()/255.f, color.y()/255.f, color.z()/255.f, 1.f;
+            this->TBO_S.update(meshId, texel);
+        }
         void translate(Eigen::Vector4d delta) {
             // delta = this->Adjust_Mat.inverse()*delta;
             this->tx += delta(0); this->ty += delta(1);
@@ -1048,51 +1833,352 @@ class _3dObject {
             }
         }
         void flatten() {
+            // a running background unfold owns the islands, let it finish first
+            this->finishUnfold();
             // delete all flatten object first
             this->flattenObjs.clear();
 
             // create a new flatten object using selected meshes
             // use all meshes if no mesh is selected
-            Eigen::VectorXi selectedIDX;
-            if (this->selectedMeshes.size() == 0) {
-                selectedIDX = this->IDX;
+            std::vector<int> pending;
+            for (int i = 0; i < this->IDX.rows()/3; i++) {
+                if (this->selectedMeshes.size() == 0 || this->selectedMeshes.find(i) != this->selectedMeshes.end())
+                    pending.push_back(i);
+            }
+
+            // big selections show the net of a coarse proxy at once, the full net replaces it when it is done
+            if (pending.size() > PROXY_FACE_THRESHOLD) {
+                this->previewProxy(pending);
+                this->unfolding = true;
+                this->unfoldDone = false;
+                this->unfoldThread = std::thread([this, pending]() {
+                    this->unfold(pending);
+                    this->unfoldDone = true;
+                });
+                return;
+            }
+            this->unfold(pending);
+            this->showIslands();
+        }
+        void unfold(std::vector<int> pending) {
+            std::cout << "starts flattening" << std::endl;
+            this->mergeCoplanar(pending);
+
+            // big meshes are cut into charts first, each chart unfolds on its own thread
+            std::vector<std::vector<int>> charts;
+            if (pending.size() > CHART_FACE_THRESHOLD) {
+                charts = this->segmentCharts(pending);
+                std::cout << "chart # = " << charts.size() << std::endl;
             }
             else {
-                selectedIDX.resize((selectedMeshes.size()*3));
-                int i = 0;
-                for (auto meshId: this->selectedMeshes) {
-                    selectedIDX(i++) = this->IDX(meshId*3);
-                    selectedIDX(i++) = this->IDX(meshId*3+1);
-                    selectedIDX(i++) = this->IDX(meshId*3+2);
+                charts.push_back(pending);
+            }
+            std::vector<std::vector<FlattenObject>> chartIslands(charts.size());
+            parallel_for(charts.size(), [&](int i) {
+                while (!charts[i].empty()) {
+                    chartIslands[i].push_back(FlattenObject(this->V3, this->IDX, charts[i], &this->forcedCuts, &this->forcedFolds, &this->face2poly, &this->polys));
+                }
+            });
+            for (auto &islands: chartIslands) {
+                for (FlattenObject &flatObj: islands) {
+                    this->flattenObjs.push_back(flatObj);
                 }
             }
-            std::cout << "starts flattening" << std::endl;
-            std::vector<bool> meshFlattened(selectedIDX.rows()/3, false);
-
-            int flattedCnt = 0;
-            while (flattedCnt < selectedIDX.rows()/3) {
-                this->flattenObjs.push_back(FlattenObject(this->V, selectedIDX, meshFlattened));
-                // check tree
-                std::cout << "check tree in 3d object flatten" << std::endl;
-                for (FlattenObject& flatObj: this->flattenObjs) {
-                    Mesh* root = flatObj.meshes.begin()->second;
-                    std::queue<Mesh*> q;
-                    q.push(root);
-                    std::cout << "tree" << std::endl;
-                    while (!q.empty()) {
-                        Mesh* cur = q.front();
-                        q.pop();
-                        std::cout << cur->id << std::endl;
-                        for (Mesh* child: cur->childs) {
-                            q.push(child);
+
+            this->indexIslands();
+            this->mergeIslands();
+            this->glueIslands();
+        }
+        // buffers can only be made on the main thread
+        void showIslands() {
+            for (FlattenObject &flatObj: this->flattenObjs) {
+                flatObj.upload();
+            }
+            this->layoutIslands();
+        }
+        void previewProxy(const std::vector<int> &faces) {
+            Eigen::VectorXi proxyIDX(3*faces.size());
+            for (int i = 0; i < faces.size(); i++) {
+                proxyIDX.segment(3*i, 3) = this->IDX.segment(3*faces[i], 3);
+            }
+            Eigen::MatrixXd proxyV = this->V;
+            cluster_mesh(proxyV, proxyIDX, PROXY_TARGET_FACES);
+            delete this->proxy;
+            this->proxy = new _3dObject(proxyV, proxyIDX);
+            this->proxy->layoutMode = this->layoutMode;
+            this->proxy->paper = this->paper;
+            this->proxy->pageBudget = this->pageBudget;
+            // unfolded here on the main thread, the proxy never gets a proxy or a worker of its own
+            std::vector<int> proxyFaces(proxyIDX.rows()/3);
+            for (int i = 0; i < proxyFaces.size(); i++) {
+                proxyFaces[i] = i;
+            }
+            this->proxy->unfold(proxyFaces);
+            this->proxy->showIslands();
+        }
+        // swap in the full net once the worker is done, called every frame
+        void pollUnfold() {
+            if (this->unfolding && this->unfoldDone) this->finishUnfold();
+        }
+        void finishUnfold() {
+            if (!this->unfolding) return;
+            this->unfoldThread.join();
+            this->unfolding = false;
+            delete this->proxy;
+            this->proxy = nullptr;
+            this->showIslands();
+        }
+        // islands to draw, the proxy ones until the full net is ready
+        std::vector<FlattenObject>& shownIslands() {
+            return this->unfolding? this->proxy->flattenObjs : this->flattenObjs;
+        }
+        // group edge-connected faces lying in the same plane, the unfolder places each group as one polygon
+        void mergeCoplanar(const std::vector<int> &faces) {
+            this->face2poly.assign(this->IDX.rows()/3, -1);
+            this->polys.clear();
+            std::vector<bool> inFaces(this->IDX.rows()/3, false);
+            for (int meshId: faces) {
+                inFaces[meshId] = true;
+            }
+            double cosMax = cos(COPLANAR_ANGLE*PI/180.0);
+            for (int seed: faces) {
+                if (this->face2poly[seed] >= 0) continue;
+                int polyId = this->polys.size();
+                this->polys.push_back(std::vector<int>());
+                // compare against the seed so that a smooth surface does not drift into one polygon
+                Eigen::Vector4d normal = this->meshes[seed]->normal;
+                std::queue<int> q;
+                q.push(seed);
+                this->face2poly[seed] = polyId;
+                while (!q.empty()) {
+                    int meshId = q.front();
+                    q.pop();
+                    this->polys[polyId].push_back(meshId);
+                    for (int k = 0; k < 3; k++) {
+                        int v1 = this->IDX(meshId*3+k), v2 = this->IDX(meshId*3+(k+1)%3);
+                        Edge edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+                        std::vector<int> &edgeFaces = this->edge2faces[edge];
+                        if (edgeFaces.size() != 2 || this->forcedCuts.find(edge) != this->forcedCuts.end()) continue;
+                        int nebMeshId = edgeFaces[0] == meshId? edgeFaces[1] : edgeFaces[0];
+                        if (this->face2poly[nebMeshId] != -1) continue;
+                        if (!inFaces[nebMeshId]) continue;
+                        if (normal.dot(this->meshes[nebMeshId]->normal) < cosMax) continue;
+                        this->face2poly[nebMeshId] = polyId;
+                        q.push(nebMeshId);
+                    }
+                }
+            }
+            std::cout << "polygon # = " << this->polys.size() << std::endl;
+        }
+        // region growing over the faces, a chart stops at CHART_TARGET_SIZE faces or when a face
+        // turns more than CHART_MAX_ANGLE away from the average normal of the chart
+        std::vector<std::vector<int>> segmentCharts(const std::vector<int> &faces) {
+            const int FREE = -1, SKIP = -2;
+            std::vector<int> face2chart(this->IDX.rows()/3, SKIP);
+            for (int meshId: faces) {
+                face2chart[meshId] = FREE;
+            }
+            double cosMax = cos(CHART_MAX_ANGLE*PI/180.0);
+
+            std::vector<std::vector<int>> charts;
+            for (int seed: faces) {
+                if (face2chart[seed] != FREE) continue;
+                int chartId = charts.size();
+                charts.push_back(std::vector<int>());
+                std::vector<int> &chart = charts.back();
+                Eigen::Vector4d normalSum = Eigen::Vector4d::Zero();
+                std::queue<int> q;
+                q.push(seed);
+                face2chart[seed] = chartId;
+                while (!q.empty() && chart.size() < CHART_TARGET_SIZE) {
+                    int meshId = q.front();
+                    q.pop();
+                    chart.push_back(meshId);
+                    normalSum += this->meshes[meshId]->normal;
+                    Eigen::Vector4d chartNormal = normalSum.normalized();
+                    for (int k = 0; k < 3; k++) {
+                        int v1 = this->IDX(meshId*3+k), v2 = this->IDX(meshId*3+(k+1)%3);
+                        Edge edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+                        for (int nebMeshId: this->edge2faces[edge]) {
+                            if (face2chart[nebMeshId] != FREE) continue;
+                            if (chartNormal.dot(this->meshes[nebMeshId]->normal) < cosMax) continue;
+                            // whole polygons go to the same chart
+                            for (int polyMeshId: this->polys[this->face2poly[nebMeshId]]) {
+                                if (face2chart[polyMeshId] != FREE) continue;
+                                face2chart[polyMeshId] = chartId;
+                                q.push(polyMeshId);
+                            }
                         }
                     }
                 }
+                // faces queued past the size limit go back to the free faces
+                while (!q.empty()) {
+                    face2chart[q.front()] = FREE;
+                    q.pop();
+                }
+            }
+            return charts;
+        }
+        // reattach small islands to a neighbour island through one of their cut edges if it stays overlap free
+        void mergeIslands() {
+            int islandCnt = this->flattenObjs.size();
+            std::vector<int> order;
+            for (int i = 0; i < this->flattenObjs.size(); i++) {
+                if (this->flattenObjs[i].flattened.size() <= ISLAND_MERGE_SIZE) order.push_back(i);
+            }
+            std::sort(order.begin(), order.end(), [this](int a, int b) {
+                return this->flattenObjs[a].flattened.size() < this->flattenObjs[b].flattened.size();
+            });
+
+            for (int i: order) {
+                FlattenObject &small = this->flattenObjs[i];
+                if (small.flattened.empty()) continue;
+                // candidate edges towards other islands, longest first as in the spanning tree
+                std::vector<Node> candidates;
+                for (int meshId: small.flattened) {
+                    Mesh* mesh = small.meshes[meshId];
+                    for (int k = 0; k < 3; k++) {
+                        int v1 = mesh->vids[k], v2 = mesh->vids[(k+1)%3];
+                        Edge edge = v1 < v2? std::make_pair(v1, v2) : std::make_pair(v2, v1);
+                        if (this->forcedCuts.find(edge) != this->forcedCuts.end()) continue;
+                        for (int nebMeshId: this->edge2faces[edge]) {
+                            int j = this->face2island[nebMeshId];
+                            if (j < 0 || j == i) continue;
+                            candidates.push_back(Node(small.edgeWeight(edge), edge, nebMeshId, meshId));
+                        }
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end(), [](const Node &a, const Node &b) {
+                    return a.weight > b.weight;
+                });
+                std::vector<int> moved(small.flattened.begin(), small.flattened.end());
+                for (Node &node: candidates) {
+                    int j = this->face2island[node.parentMeshId];
+                    FlattenObject &target = this->flattenObjs[j];
+                    if (target.absorb(small, node.parentMeshId, small.meshes[node.meshId], node.edge)) {
+                        for (int meshId: moved) {
+                            this->face2island[meshId] = j;
+                        }
+                        target.refresh();
+                        break;
+                    }
+                }
+            }
+
+            // drop the absorbed islands
+            this->flattenObjs.erase(std::remove_if(this->flattenObjs.begin(), this->flattenObjs.end(), [](const FlattenObject &flatObj) {
+                return flatObj.flattened.empty();
+            }), this->flattenObjs.end());
+            this->indexIslands();
+            std::cout << "merged islands " << islandCnt << " -> " << this->flattenObjs.size() << std::endl;
+        }
+        // check every island of the final net in parallel, returns the number of overlapping mesh pairs
+        int certifyIslands() {
+            this->finishUnfold();
+            std::vector<std::vector<std::pair<int, int>>> overlaps(this->flattenObjs.size());
+            parallel_for(this->flattenObjs.size(), [&](int i) {
+                overlaps[i] = this->flattenObjs[i].certify();
+            });
+            int overlapCnt = 0;
+            for (int i = 0; i < overlaps.size(); i++) {
+                for (auto pair: overlaps[i]) {
+                    std::cout << "island " << i << ": mesh " << pair.first << " overlaps mesh " << pair.second << std::endl;
+                }
+                overlapCnt += overlaps[i].size();
+            }
+            return overlapCnt;
+        }
+        void indexIslands() {
+            this->face2island.assign(this->IDX.rows()/3, -1);
+            for (int i = 0; i < this->flattenObjs.size(); i++) {
+                for (int meshId: this->flattenObjs[i].flattened) {
+                    this->face2island[meshId] = i;
+                }
+            }
+        }
+        void addIslands(std::vector<Mesh*> pool) {
+            while (!pool.empty()) {
+                this->flattenObjs.push_back(FlattenObject(this->V3, pool, &this->forcedCuts, &this->forcedFolds, &this->face2poly, &this->polys));
+                this->flattenObjs.back().upload();
+            }
+        }
+        // force an edge of meshId to be cut or folded, only the subtree hanging from the edge is unfolded again
+        bool setEdgeMode(int meshId, Edge edge, int mode) {
+            this->forcedCuts.erase(edge);
+            this->forcedFolds.erase(edge);
+            if (mode == EDGE_CUT) this->forcedCuts.insert(edge);
+            else if (mode == EDGE_FOLD) this->forcedFolds.insert(edge);
 
-                flattedCnt = 0;
-                for (int i = 0; i < meshFlattened.size(); i++) {
-                    flattedCnt += meshFlattened[i];
+            // find the other flattened mesh sharing the edge
+            if (meshId < 0 || this->face2island[meshId] < 0) return false;
+            int nebMeshId = -1;
+            for (int id: this->edge2faces[edge]) {
+                if (id != meshId && this->face2island[id] >= 0) nebMeshId = id;
+            }
+            if (nebMeshId < 0) return false;
+            Mesh* meshA = this->flattenObjs[this->face2island[meshId]].meshes[meshId];
+            Mesh* meshB = this->flattenObjs[this->face2island[nebMeshId]].meshes[nebMeshId];
+            bool hinge = (meshB->parent == meshA && meshB->rotEdge == edge) || (meshA->parent == meshB && meshA->rotEdge == edge);
+
+            if (mode == EDGE_CUT) {
+                if (!hinge) return true;
+                Mesh* child = meshB->parent == meshA? meshB : meshA;
+                FlattenObject &island = this->flattenObjs[this->face2island[child->id]];
+                std::vector<Mesh*> pool = island.detachSubtree(child);
+                pool = island.regrow(pool);
+                island.refresh();
+                this->addIslands(pool);
+            }
+            else {
+                // a freed edge is folded again when it fits, like a forced fold that is not kept
+                if (hinge) return true;
+                // move the subtree that does not contain the other mesh, otherwise the smaller one
+                int islandA = this->face2island[meshId], islandB = this->face2island[nebMeshId];
+                FlattenObject &flatA = this->flattenObjs[islandA];
+                Mesh* mover = meshB;
+                Mesh* anchor = meshA;
+                if (islandA == islandB && flatA.isAncestor(meshB, meshA)) {
+                    std::swap(mover, anchor);
                 }
+                else if (!(islandA == islandB && flatA.isAncestor(meshA, meshB)) && flatA.subtreeSize(meshA) < flatA.subtreeSize(meshB)) {
+                    std::swap(mover, anchor);
+                }
+                int fromIdx = this->face2island[mover->id];
+                FlattenObject &from = this->flattenObjs[fromIdx];
+                FlattenObject &to = this->flattenObjs[this->face2island[anchor->id]];
+                std::vector<Mesh*> pool = from.detachSubtree(mover);
+                if (!to.attachThrough(anchor->id, mover, edge, pool)) {
+                    // the edge stays cut, so it is not kept as a forced fold
+                    this->forcedFolds.erase(edge);
+                    std::cout << "the fold overlaps the net, the edge stays cut" << std::endl;
+                }
+                pool = from.regrow(pool);
+                bool fromEmpty = from.flattened.empty();
+                from.refresh();
+                to.refresh();
+                this->addIslands(pool);
+                if (fromEmpty) {
+                    this->flattenObjs.erase(this->flattenObjs.begin()+fromIdx);
+                }
+            }
+
+            this->indexIslands();
+            this->glueIslands();
+            this->layoutIslands();
+            return true;
+        }
+        void layoutIslands() {
+            this->printScale = PRINT_MODEL_SIZE/(this->box.col(1)-this->box.col(0)).head<3>().maxCoeff();
+            // start over from the unfolded positions, turned so that every island fills its box best
+            std::vector<double> angles(this->flattenObjs.size());
+            parallel_for(this->flattenObjs.size(), [&](int i) {
+                angles[i] = min_area_rect_angle(convex_hull_2d(this->flattenObjs[i].footprint()));
+            });
+            for (int i = 0; i < this->flattenObjs.size(); i++) {
+                Eigen::MatrixXd R = Eigen::MatrixXd::Identity(4, 4);
+                R.col(0)(0) = std::cos(angles[i]); R.col(0)(1) = std::sin(angles[i]);
+                R.col(1)(0) = -std::sin(angles[i]); R.col(1)(1) = std::cos(angles[i]);
+                this->flattenObjs[i].ModelMat = R;
             }
 
             // scale all islands with a same ratio to fit the window
@@ -1100,7 +2186,7 @@ class _3dObject {
             Eigen::MatrixXd boundingBox(2, 2);
             double deltaY = 0.;
             for (FlattenObject &flatObj: this->flattenObjs) {
-                Eigen::MatrixXd box = get_bounding_box_2d(flatObj.fV);
+                Eigen::MatrixXd box = get_bounding_box_2d(flatObj.ModelMat*flatObj.footprint());
                 islandsBoxs.push_back(box);
                 if (box.col(1)(1)-box.col(0)(1) > deltaY) {
                     deltaY = box.col(1)(1)-box.col(0)(1);
@@ -1112,25 +2198,48 @@ class _3dObject {
                 std::cout << "mesh # = " << flatObj.fV.cols()/3 << std::endl;
             }
 
-            // arrange the layout of islands on paper
-            double maxW = 0.;
+            // arrange the layout of islands on paper, the paper is about square but never narrower than an island
+            // the gap between islands follows the size of the islands, not the units of the model
+            double margin = 0.;
             for (auto box: islandsBoxs) {
-                maxW = fmax(maxW, box.col(1).x()-box.col(0).x());
+                margin = fmax(margin, ISLAND_MARGIN*fmax(box.col(1).x()-box.col(0).x(), box.col(1).y()-box.col(0).y()));
             }
-            double paperL = 0., paperT = 0., paperR = maxW, paperB = 0.;
-            double curX = paperL, curY = paperT;
-            double margin = 0.1;
-            for (int i = 0; i < this->flattenObjs.size(); i++) {
-                FlattenObject &flatObj = this->flattenObjs[i];
-                Eigen::Matrix2d box = islandsBoxs[i];
+            double maxW = 0., area = 0., usedArea = 0.;
+            std::vector<Eigen::Vector2d> sizes;
+            for (auto box: islandsBoxs) {
                 double w = box.col(1).x()-box.col(0).x(), h = box.col(1).y()-box.col(0).y();
-                if (curX+w+margin > paperR) {
-                    curX = paperL;
-                    curY = paperB;
+                sizes.push_back(Eigen::Vector2d(w+margin, h+margin));
+                maxW = fmax(maxW, w+margin);
+                area += (w+margin)*(h+margin);
+            }
+            for (FlattenObject &flatObj: this->flattenObjs) {
+                for (int i = 0; i < flatObj.fV.cols(); i += 3) {
+                    Eigen::Vector3d a = flatObj.fV.col(i).head<3>(), b = flatObj.fV.col(i+1).head<3>(), c = flatObj.fV.col(i+2).head<3>();
+                    usedArea += (b-a).cross(c-a).norm()/2.;
                 }
-                islandMoveTo(curX, curY, box, flatObj);
-                curX += w+margin;
-                paperB = fmin(paperB, curY-(h+margin));
+            }
+            double paperL = 0., paperT = 0., paperW = fmax(maxW, sqrt(area)), paperH = 0.;
+            if (this->layoutMode == LAYOUT_NEST) {
+                paperH = this->nestIslands(margin, paperW);
+            }
+            else if (this->layoutMode == LAYOUT_PAGES) {
+                paperH = this->paginateIslands(sizes, islandsBoxs, margin, paperW);
+            }
+            else {
+                std::vector<Eigen::Vector2d> corners = pack_skyline(sizes, paperW, paperH);
+                for (int i = 0; i < this->flattenObjs.size(); i++) {
+                    islandMoveTo(paperL+corners[i].x(), paperT-corners[i].y(), islandsBoxs[i], this->flattenObjs[i]);
+                }
+            }
+            double paperR = paperL+paperW, paperB = paperT-paperH;
+            this->paperSize = Eigen::Vector2d(paperW, paperH);
+            if (this->layoutMode == LAYOUT_PAGES) {
+                Eigen::Vector2d sheet = get_paper_size(this->paper)/this->printScale;
+                std::cout << "pages = " << this->pageCnt << std::endl;
+                std::cout << "paper utilization = " << usedArea/(this->pageCnt*sheet.x()*sheet.y()) << std::endl;
+            }
+            else {
+                std::cout << "paper utilization = " << usedArea/fmax((paperR-paperL)*paperH, ESP) << std::endl;
             }
 
             // scale the whole paper to fit the window
@@ -1140,6 +2249,7 @@ class _3dObject {
             for (FlattenObject &flatObj: this->flattenObjs) {
                 flatObj.ModelMat = S*flatObj.ModelMat;
             }
+            this->paperToWindow = S;
 
             // move paper center to the center of the screen
             Eigen::Vector4d paperCenter(scaleFactor*(paperL+paperR)/2.0, scaleFactor*(paperT+paperB)/2.0, 0., 1.);
@@ -1147,12 +2257,401 @@ class _3dObject {
             for (FlattenObject &flatObj: this->flattenObjs) {
                 flatObj.translate(delta);
             }
+            this->paperToWindow.col(3).head<3>() = delta.head<3>();
+        }
+        // spread the boxes of the islands over as many sheets as needed at the print scale, the sheets are
+        // put in rows starting at (0, 0) with a gap between them. Returns the height of all rows.
+        double paginateIslands(const std::vector<Eigen::Vector2d> &sizes, const std::vector<Eigen::Matrix2d> &islandsBoxs,
+                               double margin, double &paperW) {
+            Eigen::Vector2d printable = get_paper_size(this->paper)-Eigen::Vector2d(2*PAGE_MARGIN, 2*PAGE_MARGIN);
+            if (this->pageBudget > 0) {
+                this->printScale = fit_page_scale(sizes, margin, printable, this->pageBudget);
+                std::cout << "print scale = " << this->printScale << " mm per unit" << std::endl;
+            }
+            Eigen::Vector2d sheet = get_paper_size(this->paper)/this->printScale;
+            double border = PAGE_MARGIN/this->printScale, gap = 0.1*sheet.x();
+            // the margin of the last box in a row or column may go into the border
+            std::vector<Eigen::Vector3d> placements = paginate_boxes(sizes, sheet.x()-2*border+margin,
+                                                                     sheet.y()-2*border+margin, this->pageCnt);
+            this->pageCols = ceil(sqrt(this->pageCnt));
+            int tooBig = 0;
+            for (int i = 0; i < this->flattenObjs.size(); i++) {
+                int page = placements[i].z();
+                Eigen::Vector2d pageLT = this->pageOrigin(page)+Eigen::Vector2d(border, -border);
+                this->flattenObjs[i].page = page;
+                islandMoveTo(pageLT.x()+placements[i].x(), pageLT.y()-placements[i].y(), islandsBoxs[i], this->flattenObjs[i]);
+                if (sizes[i].x()-margin > sheet.x()-2*border || sizes[i].y()-margin > sheet.y()-2*border) tooBig++;
+            }
+            if (tooBig > 0)
+                std::cout << "warning: " << tooBig << " islands are larger than a page at this scale" << std::endl;
+            int rows = (this->pageCnt+this->pageCols-1)/this->pageCols;
+            paperW = this->pageCols*sheet.x()+(this->pageCols-1)*gap;
+            return rows*sheet.y()+(rows-1)*gap;
+        }
+        // left top corner of a sheet in paper coordinates
+        Eigen::Vector2d pageOrigin(int page) {
+            Eigen::Vector2d sheet = get_paper_size(this->paper)/this->printScale;
+            double gap = 0.1*sheet.x();
+            return Eigen::Vector2d((page%this->pageCols)*(sheet.x()+gap), -(page/this->pageCols)*(sheet.y()+gap));
+        }
+        // number the cut edges that are glued together, both sides of an edge get the same label. The first
+        // side met waits in a hash table under the id of its edge and the second one takes the next number,
+        // so the labels are compact and come from a single pass over the cut edges. Returns the label count.
+        int labelGlueEdges() {
+            std::vector<std::vector<std::pair<int, int>>> islandCuts(this->flattenObjs.size());
+            parallel_for(islandCuts.size(), [&](int i) {
+                islandCuts[i] = this->flattenObjs[i].cutEdges();
+            });
+            long long vertexCnt = this->V3.cols();
+            std::unordered_map<long long, Eigen::Vector2i> waiting;
+            int labelCnt = 0;
+            for (int i = 0; i < islandCuts.size(); i++) {
+                std::vector<Eigen::Vector3i> &glueEdges = this->flattenObjs[i].glueEdges;
+                glueEdges.clear();
+                for (auto &cut: islandCuts[i]) {
+                    Mesh* mesh = this->flattenObjs[i].meshes[cut.first];
+                    long long v1 = mesh->vids[cut.second], v2 = mesh->vids[(cut.second+1)%3];
+                    long long edgeId = std::min(v1, v2)*vertexCnt+std::max(v1, v2);
+                    auto other = waiting.find(edgeId);
+                    if (other == waiting.end()) {
+                        waiting[edgeId] = Eigen::Vector2i(i, glueEdges.size());
+                        glueEdges.push_back(Eigen::Vector3i(-1, cut.first, cut.second));
+                        continue;
+                    }
+                    labelCnt++;
+                    this->flattenObjs[other->second(0)].glueEdges[other->second(1)](0) = labelCnt;
+                    glueEdges.push_back(Eigen::Vector3i(labelCnt, cut.first, cut.second));
+                    waiting.erase(other);
+                }
+            }
+            return labelCnt;
+        }
+        // the window positions of the flattened faces, every island through its layout
+        Eigen::MatrixXd layoutBox() {
+            Eigen::MatrixXd box(2, 2);
+            box << DIST_MAX, -DIST_MAX, DIST_MAX, -DIST_MAX;
+            for (FlattenObject &flatObj: this->flattenObjs) {
+                if (flatObj.fV.cols() == 0) continue;
+                Eigen::MatrixXd islandBox = get_bounding_box_2d(flatObj.ModelMat*flatObj.fV);
+                box.col(0) = box.col(0).cwiseMin(islandBox.col(0));
+                box.col(1) = box.col(1).cwiseMax(islandBox.col(1));
+            }
+            return box;
+        }
+        // write the flattened faces as an obj with a texture coordinate for every corner, taken from the
+        // island layout. The layout is scaled by the same factor along u and v so the atlas keeps the zero
+        // distortion of the net, box is the window area that maps to [0, 1]. A corner shares the texture
+        // coordinate of the corners of its island on the same vertex and flat position. Vertex ids start
+        // after firstVertex, returns the vertex count.
+        int exportObj(TextWriter &out, int firstVertex, int firstUV, int &uvCnt, const Eigen::MatrixXd &box) {
+            double scale = 1./fmax(fmax(box(0, 1)-box(0, 0), box(1, 1)-box(1, 0)), ESP);
+            for (int v = 0; v < this->V3.cols(); v++) {
+                out << "v " << this->V3(0, v) << ' ' << this->V3(1, v) << ' ' << this->V3(2, v) << '\n';
+            }
+            uvCnt = 0;
+            for (FlattenObject &flatObj: this->flattenObjs) {
+                std::unordered_map<int, std::vector<int>> vertexUVs;
+                std::vector<Eigen::Vector2d> uvs;
+                for (int meshId: flatObj.flattened) {
+                    Mesh* mesh = flatObj.meshes[meshId];
+                    int corners[3];
+                    for (int k = 0; k < 3; k++) {
+                        int vid = mesh->vids[k];
+                        Eigen::Vector2d uv = ((flatObj.ModelMat*to_4_point(mesh->vid2fv[vid])).head<2>()-box.col(0))*scale;
+                        corners[k] = -1;
+                        for (int id: vertexUVs[vid]) {
+                            if ((uvs[id]-uv).norm() < ESP) corners[k] = id;
+                        }
+                        if (corners[k] < 0) {
+                            corners[k] = uvs.size();
+                            vertexUVs[vid].push_back(uvs.size());
+                            uvs.push_back(uv);
+                            out << "vt " << uv.x() << ' ' << uv.y() << '\n';
+                        }
+                    }
+                    out << 'f';
+                    for (int k = 0; k < 3; k++) {
+                        out << ' ' << std::to_string(firstVertex+mesh->vids[k]+1) << '/' << std::to_string(firstUV+uvCnt+corners[k]+1);
+                    }
+                    out << '\n';
+                }
+                uvCnt += uvs.size();
+            }
+            return this->V3.cols();
+        }
+        // number the glued edges and give every glued pair a tab on one side. The tab is fitted against the
+        // faces on both sides and goes where it fits higher, then the tabs of every island are fitted against
+        // each other in the order of their edges. Both fits look up the grids of the islands, so the cost
+        // grows with the number of cut edges and not with their square.
+        void glueIslands() {
+            int labelCnt = this->labelCnt = this->labelGlueEdges();
+            int n = this->flattenObjs.size();
+            // the tabs are at most GLUE_TAB_HEIGHT millimetres high when the model is PRINT_MODEL_SIZE long
+            double maxHeight = GLUE_TAB_HEIGHT/PRINT_MODEL_SIZE*(this->box.col(1)-this->box.col(0)).head<3>().maxCoeff();
+            std::vector<std::vector<double>> heights(n);
+            parallel_for(n, [&](int i) {
+                FlattenObject &flatObj = this->flattenObjs[i];
+                for (auto &glue: flatObj.glueEdges) {
+                    Mesh* mesh = flatObj.meshes[glue(1)];
+                    double len = (mesh->vid2fv[mesh->vids[glue(2)]]-mesh->vid2fv[mesh->vids[(glue(2)+1)%3]]).norm();
+                    heights[i].push_back(glue(0) < 0? 0. : flatObj.tabFit(mesh, glue(2), fmin(GLUE_TAB_RATIO*len, maxHeight)));
+                }
+            });
+            // both sides of every label, the first one met wins a tie
+            std::vector<Eigen::Vector2i> sides[2];
+            sides[0].assign(labelCnt+1, Eigen::Vector2i(-1, -1));
+            sides[1].assign(labelCnt+1, Eigen::Vector2i(-1, -1));
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < this->flattenObjs[i].glueEdges.size(); j++) {
+                    int label = this->flattenObjs[i].glueEdges[j](0);
+                    if (label < 0) continue;
+                    sides[sides[0][label](0) < 0? 0 : 1][label] = Eigen::Vector2i(i, j);
+                }
+            }
+            std::vector<std::vector<GlueTab>> wanted(n);
+            std::vector<std::vector<double>> wantedHeights(n);
+            for (int label = 1; label <= labelCnt; label++) {
+                Eigen::Vector2i side = sides[0][label], other = sides[1][label];
+                if (heights[other(0)][other(1)] > heights[side(0)][side(1)]) std::swap(side, other);
+                if (heights[side(0)][side(1)] <= 0.) continue;
+                FlattenObject &flatObj = this->flattenObjs[side(0)];
+                Eigen::Vector3i glue = flatObj.glueEdges[side(1)];
+                Mesh* mesh = flatObj.meshes[glue(1)];
+                // the third vertex of the face the tab is glued to
+                Eigen::Vector3i otherGlue = this->flattenObjs[other(0)].glueEdges[other(1)];
+                Mesh* otherMesh = this->flattenObjs[other(0)].meshes[otherGlue(1)];
+                Eigen::Vector3d apex = otherMesh->vid2v[otherMesh->vids[(otherGlue(2)+2)%3]];
+                wanted[side(0)].push_back(GlueTab(glue(1), glue(2), Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), flatObj.isMountain(mesh, glue(2), apex)));
+                wantedHeights[side(0)].push_back(heights[side(0)][side(1)]);
+            }
+            parallel_for(n, [&](int i) {
+                this->flattenObjs[i].placeTabs(wanted[i], wantedHeights[i]);
+            });
+            int tabCnt = 0;
+            for (FlattenObject &flatObj: this->flattenObjs) {
+                tabCnt += flatObj.tabs.size();
+            }
+            std::cout << labelCnt << " glue labels, " << tabCnt << " glue tabs" << std::endl;
+        }
+        // write every sheet of a paginated layout to its own svg in millimetres, numbered from firstPage, with
+        // the glue labels after firstLabel. A sheet is streamed to its file and closed before the next one starts.
+        int exportPages(int firstPage, int firstLabel) {
+            std::vector<std::vector<int>> pageIslands = this->islandsByPage();
+            Eigen::Vector2d sheet = get_paper_size(this->paper);
+            for (int page = 0; page < this->pageCnt; page++) {
+                Eigen::MatrixXd toSheet = this->windowToSheet(this->pageOrigin(page), Eigen::Vector2d(0., 0.));
+                std::ofstream svg_file(EXPORT_PAGE_PATH+std::to_string(firstPage+page)+".svg");
+                SvgWriter out(svg_file, SVG_PAGE_PRECISION);
+                out << get_svg_sheet_header(sheet.x(), sheet.y()) << '\n';
+                this->writeIslands<SvgWriter>(out, pageIslands[page], toSheet, firstLabel);
+                out << "</svg>\n";
+            }
+            return this->pageCnt;
+        }
+        // size in millimetres of the single sheet layouts, with a border of PAGE_MARGIN around the islands
+        Eigen::Vector2d sheetSize() {
+            return this->paperSize*this->printScale+Eigen::Vector2d(2*PAGE_MARGIN, 2*PAGE_MARGIN);
+        }
+        // write the islands of a single sheet layout to out with the top of the sheet top millimetres down and
+        // the glue labels after firstLabel
+        void exportSheet(SvgWriter &out, double top, int firstLabel) {
+            Eigen::MatrixXd toSheet = this->windowToSheet(Eigen::Vector2d(0., 0.), Eigen::Vector2d(PAGE_MARGIN, top+PAGE_MARGIN));
+            std::vector<int> ids(this->flattenObjs.size());
+            for (int i = 0; i < ids.size(); i++) {
+                ids[i] = i;
+            }
+            this->writeIslands<SvgWriter>(out, ids, toSheet, firstLabel);
+        }
+        // add the sheets of the layout to a pdf, a page per sheet of a paginated layout or one page for the
+        // single sheet, with the glue labels after firstLabel. A page is streamed to the file before the next
+        // one starts.
+        void exportPdf(PdfWriter &pdf, int firstLabel) {
+            std::vector<std::vector<int>> pageIslands = this->islandsByPage();
+            for (int page = 0; page < pageIslands.size(); page++) {
+                Eigen::Vector2d sheet = this->sheetSize();
+                Eigen::MatrixXd toSheet = this->windowToSheet(Eigen::Vector2d(0., 0.), Eigen::Vector2d(PAGE_MARGIN, PAGE_MARGIN));
+                if (this->layoutMode == LAYOUT_PAGES) {
+                    sheet = get_paper_size(this->paper);
+                    toSheet = this->windowToSheet(this->pageOrigin(page), Eigen::Vector2d(0., 0.));
+                }
+                // millimetres down from the top to points up from the bottom
+                Eigen::MatrixXd toPoints = Eigen::MatrixXd::Identity(4, 4);
+                toPoints(0, 0) = PDF_POINTS_PER_MM;
+                toPoints(1, 1) = -PDF_POINTS_PER_MM; toPoints(1, 3) = sheet.y()*PDF_POINTS_PER_MM;
+                if (bake_colors && this->C.cols() > 0) {
+                    int width, height;
+                    std::vector<unsigned char> rgb;
+                    this->bakeColors(pageIslands[page], toSheet, sheet, width, height, rgb);
+                    pdf.pageImage(width, height, rgb);
+                }
+                pdf.beginPage(sheet.x()*PDF_POINTS_PER_MM, sheet.y()*PDF_POINTS_PER_MM);
+                if (bake_colors && this->C.cols() > 0)
+                    this->writeIslands<PdfBakedContent>(pdf, pageIslands[page], toPoints*toSheet, firstLabel);
+                else
+                    this->writeIslands<PdfContent>(pdf, pageIslands[page], toPoints*toSheet, firstLabel);
+                pdf.endPage();
+            }
+        }
+        // the faces of the islands ids drawn with their vertex colours into an rgb image of a sheet size
+        // millimetres, at BAKE_DPI or less when that would take more than BAKE_MAX_PIXELS
+        void bakeColors(const std::vector<int> &ids, const Eigen::MatrixXd &toSheet, Eigen::Vector2d size, int &width, int &height, std::vector<unsigned char> &rgb) {
+            double pixelsPerMm = fmin(BAKE_DPI/25.4, sqrt(BAKE_MAX_PIXELS/(size.x()*size.y())));
+            width = std::max(1, (int)ceil(size.x()*pixelsPerMm));
+            height = std::max(1, (int)ceil(size.y()*pixelsPerMm));
+            std::vector<Eigen::Vector2d> points;
+            std::vector<Eigen::Vector3d> pointColors;
+            for (int id: ids) {
+                FlattenObject &flatObj = this->flattenObjs[id];
+                Eigen::MatrixXd toPixels = toSheet*flatObj.ModelMat;
+                for (int meshId: flatObj.flattened) {
+                    Mesh* mesh = flatObj.meshes[meshId];
+                    for (int k = 0; k < 3; k++) {
+                        points.push_back((toPixels*to_4_point(mesh->vid2fv[mesh->vids[k]])).head<2>()*pixelsPerMm);
+                        pointColors.push_back(this->C.col(mesh->vids[k]));
+                    }
+                }
+            }
+            rasterize_triangles(points, pointColors, width, height, rgb);
+            std::cout << width << "x" << height << " pixels baked from " << points.size()/3 << " faces" << std::endl;
+        }
+        // write every sheet of a paginated layout to its own cutter file in millimetres, numbered from
+        // firstPage, as a dxf or as hpgl by the extension
+        int exportCutPages(int firstPage, std::string extension) {
+            std::vector<std::vector<int>> pageIslands = this->islandsByPage();
+            double height = get_paper_size(this->paper).y();
+            for (int page = 0; page < this->pageCnt; page++) {
+                CutPaths paths;
+                this->collectCutPaths(paths, pageIslands[page], this->windowToCutter(this->pageOrigin(page), Eigen::Vector2d(0., 0.), height));
+                export_cut_paths(EXPORT_PAGE_PATH+std::to_string(firstPage+page)+extension, paths);
+            }
+            return this->pageCnt;
+        }
+        // add the islands of a single sheet layout to paths with the top of the sheet top millimetres down a
+        // sheet height millimetres high
+        void cutSheet(CutPaths &paths, double top, double height) {
+            Eigen::MatrixXd toCutter = this->windowToCutter(Eigen::Vector2d(0., 0.), Eigen::Vector2d(PAGE_MARGIN, top+PAGE_MARGIN), height);
+            this->collectCutPaths(paths, this->islandsByPage()[0], toCutter);
+        }
+        // the cut outlines and fold lines of the islands, gathered in parallel and added to paths in the order
+        // of ids
+        void collectCutPaths(CutPaths &paths, const std::vector<int> &ids, const Eigen::MatrixXd &toCutter) {
+            std::vector<CutPaths> islandPaths(ids.size());
+            parallel_for(ids.size(), [&](int k) {
+                FlattenObject &flatObj = this->flattenObjs[ids[k]];
+                flatObj.write_net(islandPaths[k], toCutter*flatObj.ModelMat);
+            });
+            for (auto &islandPath: islandPaths) {
+                paths.append(islandPath);
+            }
+        }
+        // the islands on each sheet, one list per page of a paginated layout or a single list
+        std::vector<std::vector<int>> islandsByPage() {
+            std::vector<std::vector<int>> pageIslands(this->layoutMode == LAYOUT_PAGES? this->pageCnt : 1);
+            for (int i = 0; i < this->flattenObjs.size(); i++) {
+                pageIslands[this->layoutMode == LAYOUT_PAGES? this->flattenObjs[i].page : 0].push_back(i);
+            }
+            return pageIslands;
+        }
+        // the islands are serialized in parallel into buffers of their own, a batch at a time so memory stays
+        // bounded, and the buffers go to out in the order of ids
+        template <typename Writer, typename Sink>
+        void writeIslands(Sink &out, const std::vector<int> &ids, const Eigen::MatrixXd &toSheet, int firstLabel) {
+            for (int first = 0; first < ids.size(); first += EXPORT_BATCH_SIZE) {
+                int n = std::min<int>(EXPORT_BATCH_SIZE, ids.size()-first);
+                std::vector<std::string> buffers(n);
+                parallel_for(n, [&](int k) {
+                    FlattenObject &flatObj = this->flattenObjs[ids[first+k]];
+                    std::ostringstream ss;
+                    {
+                        Writer islandOut(ss, SVG_PAGE_PRECISION, SVG_ISLAND_BUFFER_SIZE);
+                        flatObj.write_net(islandOut, toSheet*flatObj.ModelMat);
+                        flatObj.write_labels(islandOut, toSheet*flatObj.ModelMat, firstLabel);
+                    }
+                    buffers[k] = ss.str();
+                });
+                for (auto &buffer: buffers) {
+                    out << buffer;
+                }
+            }
+        }
+        // takes the window positions of the islands to millimetres on a sheet, y goes down. The point origin of
+        // the paper lands on offset.
+        Eigen::MatrixXd windowToSheet(Eigen::Vector2d origin, Eigen::Vector2d offset) {
+            Eigen::MatrixXd toSheet = Eigen::MatrixXd::Identity(4, 4);
+            toSheet(0, 0) = this->printScale; toSheet(0, 3) = offset.x()-origin.x()*this->printScale;
+            toSheet(1, 1) = -this->printScale; toSheet(1, 3) = offset.y()+origin.y()*this->printScale;
+            return toSheet*this->paperToWindow.inverse();
+        }
+        // like windowToSheet with y going up from the bottom of a sheet height millimetres high, as cutters
+        // and plotters expect
+        Eigen::MatrixXd windowToCutter(Eigen::Vector2d origin, Eigen::Vector2d offset, double height) {
+            Eigen::MatrixXd flip = Eigen::MatrixXd::Identity(4, 4);
+            flip(1, 1) = -1.; flip(1, 3) = height;
+            return flip*this->windowToSheet(origin, offset);
+        }
+        // nest the islands by their outlines: every island is rasterized in a few turns into an occupancy
+        // bitmap and the bitmaps are fitted on the paper. The paper starts at (0, 0) and may get a few cells
+        // wider than paperW, returns its height.
+        double nestIslands(double margin, double &paperW) {
+            int n = this->flattenObjs.size();
+            double cell = paperW/NEST_GRID_WIDTH;
+            int dilation = std::max(1, (int)ceil(margin/(2.*cell)));
+            std::vector<std::vector<OccupancyBitmap>> masks(n, std::vector<OccupancyBitmap>(NEST_ROTATIONS));
+            std::vector<std::vector<Eigen::Matrix2d>> boxes(n, std::vector<Eigen::Matrix2d>(NEST_ROTATIONS));
+            std::vector<Eigen::Matrix4d> turns(NEST_ROTATIONS, Eigen::Matrix4d::Identity());
+            for (int r = 0; r < NEST_ROTATIONS; r++) {
+                double angle = 2.*PI*r/NEST_ROTATIONS;
+                turns[r].col(0)(0) = std::cos(angle); turns[r].col(0)(1) = std::sin(angle);
+                turns[r].col(1)(0) = -std::sin(angle); turns[r].col(1)(1) = std::cos(angle);
+            }
+            parallel_for(n, [&](int i) {
+                FlattenObject &flatObj = this->flattenObjs[i];
+                Eigen::MatrixXd footprint = flatObj.footprint();
+                for (int r = 0; r < NEST_ROTATIONS; r++) {
+                    Eigen::MatrixXd P = turns[r]*flatObj.ModelMat*footprint;
+                    Eigen::Matrix2d box = get_bounding_box_2d(P);
+                    boxes[i][r] = box;
+                    // cell rows go down from the top of the box
+                    OccupancyBitmap mask((box(0, 1)-box(0, 0))/cell+1, (box(1, 1)-box(1, 0))/cell+1);
+                    for (int k = 0; k < P.cols(); k += 3) {
+                        Eigen::Vector2d tri[3];
+                        for (int j = 0; j < 3; j++) {
+                            tri[j] = Eigen::Vector2d((P(0, k+j)-box(0, 0))/cell, (box(1, 1)-P(1, k+j))/cell);
+                        }
+                        mask.fillTriangle(tri[0], tri[1], tri[2]);
+                    }
+                    mask.dilate(dilation);
+                    masks[i][r] = mask;
+                }
+            });
+
+            int paperCells = NEST_GRID_WIDTH+2*dilation+2, paperRows = 0;
+            std::vector<Eigen::Vector3i> placements = nest_bitmaps(masks, paperCells, paperRows);
+            for (int i = 0; i < n; i++) {
+                int x = placements[i](0), y = placements[i](1), r = placements[i](2);
+                FlattenObject &flatObj = this->flattenObjs[i];
+                flatObj.ModelMat = turns[r]*flatObj.ModelMat;
+                islandMoveTo((x+dilation)*cell, -(y+dilation)*cell, boxes[i][r], flatObj);
+            }
+            paperW = paperCells*cell;
+            return paperRows*cell;
+        }
+        void setLayout(int mode, int paper, int pageBudget) {
+            this->layoutMode = mode;
+            this->paper = paper;
+            this->pageBudget = pageBudget;
+            if (this->unfolding) {
+                this->proxy->setLayout(mode, paper, pageBudget);
+            }
+            else {
+                this->layoutIslands();
+            }
         }
         void islandMoveTo(double l, double t, Eigen::Matrix2d boundBox, FlattenObject &flatObj) {
             Eigen::Vector2d leftTop = Eigen::Vector2d(l, t);
             double bminx = boundBox.col(0).x(), bmaxy = boundBox.col(1).y();
+            // the box is taken around the island as the model matrix already places it
             Eigen::Vector4d bleftTop = Eigen::Vector4d(bminx, bmaxy, 0., 1.);
-            bleftTop = flatObj.ModelMat*bleftTop;
             Eigen::Vector2d delta = leftTop - Eigen::Vector2d(bleftTop.x(), bleftTop.y());
             flatObj.translate(Eigen::Vector4d(delta(0), delta(1), 0., 0.));
         }
@@ -1182,7 +2681,7 @@ class _3dObjectBuffer {
                 // find the hitted 3D object if any
                 for (auto obj: _3d_objs) {
                     double dist = DIST_MAX;
-                    if (obj->hit(ray_origin, ray_direction, dist)) {
+                    if (obj->hit(ray_origin, ray_direction, dist, mode == EDGE_ACTION)) {
                         if (selected == nullptr || min_dist > dist) {
                             min_dist = dist;
                             selected = obj;
@@ -1192,7 +2691,7 @@ class _3dObjectBuffer {
             }
             ret_dist = min_dist;
 
-            if (mode == CILCK_ACTION) {
+            if (mode == CILCK_ACTION || mode == EDGE_ACTION) {
                 this->selected_obj = selected;
                 this->selected_flat_obj = selected_flat;
             }
@@ -1234,6 +2733,32 @@ class _3dObjectBuffer {
             }
             return false;
         }
+        bool set_edge_mode(int mode) {
+            if (this->selected_obj == nullptr || this->selected_obj->pickedMeshId < 0) return false;
+            _3dObject* obj = this->selected_obj;
+            // edits work on the full net
+            obj->finishUnfold();
+            // pressing the same key twice frees the edge again
+            if (mode == EDGE_CUT && obj->forcedCuts.find(obj->pickedEdge) != obj->forcedCuts.end()) mode = EDGE_FREE;
+            if (mode == EDGE_FOLD && obj->forcedFolds.find(obj->pickedEdge) != obj->forcedFolds.end()) mode = EDGE_FREE;
+            this->selected_flat_obj = nullptr;
+            return obj->setEdgeMode(obj->pickedMeshId, obj->pickedEdge, mode);
+        }
+        void switch_layout_mode() {
+            for (auto obj: _3d_objs) {
+                obj->setLayout((obj->layoutMode+1)%LAYOUT_MODE_NUMBER, obj->paper, obj->pageBudget);
+            }
+        }
+        void switch_paper_size() {
+            for (auto obj: _3d_objs) {
+                obj->setLayout(obj->layoutMode, (obj->paper+1)%PAPER_SIZE_NUMBER, obj->pageBudget);
+            }
+        }
+        void switch_page_budget() {
+            for (auto obj: _3d_objs) {
+                obj->setLayout(obj->layoutMode, obj->paper, (obj->pageBudget+1)%(PAGE_BUDGET_MAX+1));
+            }
+        }
         bool switch_render_mode(int mode) {
             if (this->selected_obj == nullptr) return false;
             this->selected_obj->render_mode = mode;
@@ -1262,16 +2787,6 @@ class _3dObjectBuffer {
             0,0,0,1;
             return rotate_mat;
         }
-        std::string export_flat_svg(Camera *camera) {
-            std::stringstream ss;
-            for (auto it = _3d_objs.rbegin(); it != _3d_objs.rend(); it++) {
-                for (FlattenObject &flatObj: (*it)->flattenObjs) {
-                    ss << flatObj.export_svg(camera) << std::endl;
-                }
-            }
-            std::string svg_str = ss.str();
-            return svg_str;
-        }
 };
 class Player {
     public:
@@ -1283,7 +2798,7 @@ class Player {
         void init(_3dObject* obj3d) {
             // FlattenObject& flatObj = obj3d->flattenObjs[0];
             for (FlattenObject &flatObj: obj3d->flattenObjs) {
-                waitlist.push(flatObj.meshes.begin()->second);
+                waitlist.push(flatObj.meshes[flatObj.rootId]);
             }
             frames = 10.;
             frame = 0;
@@ -1348,28 +2863,165 @@ class CameraBuffer {
 };
 
 _3dObjectBuffer* _3d_objs_buffer;
-std::vector<_3dObject*>* _3d_objs;
 // Camera *camera;
 CameraBuffer* camera_buf;
 Player player = Player();
 
-void export_svg(GLFWwindow* window) {
-    std::string svg_str = get_svg_root_template();
-    // adjust aspect ratio
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    double aspect = (double)width/(double)height;
-    svg_str = replace_all(svg_str, "$d", std::to_string(-1.0/aspect));
-    std::cout << "w: " << width << "h: " << height << std::endl;
-    std::cout << "aspect " << aspect << std::endl;
-    // flatten objects
-    std::string flat_svg_str = _3d_objs_buffer->export_flat_svg(camera_buf->getCamera());
-    svg_str = replace_all(svg_str, "$TG", flat_svg_str);
-    // Save svg to file
+// certify the net before it goes to paper
+void certify_net(const std::vector<_3dObject*> &objs) {
+    int overlapCnt = 0;
+    for (auto obj: objs) {
+        overlapCnt += obj->certifyIslands();
+    }
+    if (overlapCnt > 0)
+        std::cout << "warning: " << overlapCnt << " overlapping mesh pairs in the exported net" << std::endl;
+    else
+        std::cout << "net certified overlap free" << std::endl;
+}
+
+// the glue labels of every object continue from the labels of the objects before it, so no two objects of
+// an export share a number
+std::vector<int> first_glue_labels(const std::vector<_3dObject*> &objs) {
+    std::vector<int> firstLabels;
+    int labelCnt = 0;
+    for (auto obj: objs) {
+        firstLabels.push_back(labelCnt);
+        labelCnt += obj->labelCnt;
+    }
+    return firstLabels;
+}
+
+// write the net of the objects in millimetres from their island layouts, neither the camera nor the window
+// is needed. Objects laid out on pages get a file per sheet, the others are stacked on one sheet at path.
+void export_svg(const std::vector<_3dObject*> &objs, std::string path) {
+    certify_net(objs);
+    std::vector<int> firstLabels = first_glue_labels(objs);
+
+    int pages = 0, sheetObjs = 0;
+    double width = 0., height = 0.;
+    for (int i = 0; i < objs.size(); i++) {
+        _3dObject* obj = objs[i];
+        if (obj->layoutMode == LAYOUT_PAGES) {
+            pages += obj->exportPages(pages+1, firstLabels[i]);
+        }
+        else {
+            width = fmax(width, obj->sheetSize().x());
+            height += obj->sheetSize().y();
+            sheetObjs++;
+        }
+    }
+    if (pages > 0)
+        std::cout << pages << " pages exported" << std::endl;
+    // no single sheet when every object is on pages
+    if (sheetObjs == 0) return;
+    // the other objects are streamed to the file one under the other
     std::ofstream svg_file;
-    svg_file.open (EXPORT_PATH);
-    svg_file << svg_str;
-    svg_file.close();
+    svg_file.open (path);
+    SvgWriter out(svg_file, SVG_PAGE_PRECISION);
+    out << get_svg_sheet_header(width, height) << '\n';
+    double top = 0.;
+    for (int i = 0; i < objs.size(); i++) {
+        _3dObject* obj = objs[i];
+        if (obj->layoutMode == LAYOUT_PAGES) continue;
+        obj->exportSheet(out, top, firstLabels[i]);
+        top += obj->sheetSize().y();
+    }
+    out << "</svg>\n";
+}
+
+// write the net of the objects to a pdf in millimetres, every sheet of the layouts on a page of its own
+void export_pdf(const std::vector<_3dObject*> &objs, std::string path) {
+    certify_net(objs);
+    std::vector<int> firstLabels = first_glue_labels(objs);
+    PdfWriter pdf(path);
+    for (int i = 0; i < objs.size(); i++) {
+        objs[i]->exportPdf(pdf, firstLabels[i]);
+    }
+}
+
+// write the cut outlines and the fold lines of the objects for a laser cutter or a plotter, to a dxf or to
+// hpgl by the extension of path. Objects laid out on pages get a file per sheet, the others are stacked
+// on one sheet at path.
+void export_cutter(const std::vector<_3dObject*> &objs, std::string path) {
+    certify_net(objs);
+
+    std::string extension = path.substr(path.rfind('.'));
+    int pages = 0, sheetObjs = 0;
+    double height = 0.;
+    for (auto obj: objs) {
+        if (obj->layoutMode == LAYOUT_PAGES) {
+            pages += obj->exportCutPages(pages+1, extension);
+        }
+        else {
+            height += obj->sheetSize().y();
+            sheetObjs++;
+        }
+    }
+    if (pages > 0)
+        std::cout << pages << " pages exported" << std::endl;
+    // no single sheet when every object is on pages
+    if (sheetObjs == 0) return;
+    CutPaths paths;
+    double top = 0.;
+    for (auto obj: objs) {
+        if (obj->layoutMode == LAYOUT_PAGES) continue;
+        obj->cutSheet(paths, top, height);
+        top += obj->sheetSize().y();
+    }
+    export_cut_paths(path, paths);
+}
+
+// write the flattened faces of the objects to an obj with their island layouts as a texture atlas, the
+// layouts of all objects share the [0, 1] square
+void export_obj(const std::vector<_3dObject*> &objs, std::string path) {
+    Eigen::MatrixXd box(2, 2);
+    box << DIST_MAX, -DIST_MAX, DIST_MAX, -DIST_MAX;
+    for (auto obj: objs) {
+        obj->finishUnfold();
+        Eigen::MatrixXd objBox = obj->layoutBox();
+        box.col(0) = box.col(0).cwiseMin(objBox.col(0));
+        box.col(1) = box.col(1).cwiseMax(objBox.col(1));
+    }
+    std::ofstream obj_file(path);
+    TextWriter out(obj_file, OBJ_PRECISION);
+    int vertexCnt = 0, uvCnt = 0;
+    for (int i = 0; i < objs.size(); i++) {
+        out << "o object_" << std::to_string(i) << '\n';
+        int objUVs = 0;
+        vertexCnt += objs[i]->exportObj(out, vertexCnt, uvCnt, objUVs, box);
+        uvCnt += objUVs;
+    }
+    std::cout << vertexCnt << " vertexes and " << uvCnt << " texture coordinates exported" << std::endl;
+}
+
+// unfold an OFF file and export its net without opening a window, to a pdf, a dxf, hpgl or an obj atlas by
+// the extension of the path
+int export_headless(std::string off_path, std::string svg_path) {
+    Eigen::MatrixXd V, C;
+    Eigen::VectorXi IDX;
+    if (!loadMeshfromOFF(off_path, V, C, IDX)) return -1;
+    decimate_mesh(V, C, IDX, DECIMATE_TARGET_FACES, DECIMATE_MAX_ERROR);
+    _3dObject obj(V, IDX);
+    // a COFF file prints in its colours
+    obj.C = C;
+    bake_colors = C.cols() > 0;
+    std::vector<int> pending(IDX.rows()/3);
+    for (int i = 0; i < pending.size(); i++) {
+        pending[i] = i;
+    }
+    obj.unfold(pending);
+    obj.layoutIslands();
+    std::vector<_3dObject*> objs(1, &obj);
+    std::string extension = svg_path.substr(std::min(svg_path.size(), svg_path.rfind('.')));
+    if (extension == ".pdf")
+        export_pdf(objs, svg_path);
+    else if (extension == ".dxf" || extension == ".plt" || extension == ".hpgl")
+        export_cutter(objs, svg_path);
+    else if (extension == ".obj")
+        export_obj(objs, svg_path);
+    else
+        export_svg(objs, svg_path);
+    return 0;
 }
 
 Eigen::Vector4d get_click_position(GLFWwindow* window, int &subWindow) {
@@ -1440,7 +3092,9 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
             }
         }
         double dist = 0;
-        if (_3d_objs_buffer->hit(subWindow, ray_origin, ray_direction, dist)) {
+        // shift click picks the edge to cut or fold
+        int mode = (mods & GLFW_MOD_SHIFT)? EDGE_ACTION : CILCK_ACTION;
+        if (_3d_objs_buffer->hit(subWindow, ray_origin, ray_direction, dist, mode)) {
             drag = true;
             hit_dist = dist;
             pre_cursor_point = click_point;
@@ -1473,7 +3127,28 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case  GLFW_KEY_0:
             if (action == GLFW_PRESS) {
                 glfwSetWindowTitle (window, "export SVG");
-                export_svg(window);
+                export_svg(_3d_objs_buffer->_3d_objs, EXPORT_PATH);
+            }
+            break;
+        // export pdf
+        case  GLFW_KEY_9:
+            if (action == GLFW_PRESS) {
+                glfwSetWindowTitle (window, "export PDF");
+                export_pdf(_3d_objs_buffer->_3d_objs, EXPORT_PDF_PATH);
+            }
+            break;
+        // export dxf for laser cutters
+        case  GLFW_KEY_8:
+            if (action == GLFW_PRESS) {
+                glfwSetWindowTitle (window, "export DXF");
+                export_cutter(_3d_objs_buffer->_3d_objs, EXPORT_DXF_PATH);
+            }
+            break;
+        // export hpgl for plotters
+        case  GLFW_KEY_7:
+            if (action == GLFW_PRESS) {
+                glfwSetWindowTitle (window, "export HPGL");
+                export_cutter(_3d_objs_buffer->_3d_objs, EXPORT_HPGL_PATH);
             }
             break;
         // import an object
@@ -1679,11 +3354,63 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
                 }
             }
             break;
+        // force the picked edge to be cut
+        case GLFW_KEY_X:
+            if (action == GLFW_PRESS && !player.playing) {
+                if (_3d_objs_buffer->set_edge_mode(EDGE_CUT)) {
+                    glfwSetWindowTitle (window, "toggle cut on the picked edge");
+                }
+            }
+            break;
+        // force the picked edge to be folded
+        case GLFW_KEY_Z:
+            if (action == GLFW_PRESS && !player.playing) {
+                if (_3d_objs_buffer->set_edge_mode(EDGE_FOLD)) {
+                    glfwSetWindowTitle (window, "toggle fold on the picked edge");
+                }
+            }
+            break;
+        // switch the paper size of the paginated layout
+        case GLFW_KEY_P:
+            if (action == GLFW_PRESS && !player.playing) {
+                _3d_objs_buffer->switch_paper_size();
+                glfwSetWindowTitle (window, "switch paper size");
+            }
+            break;
+        // fit the paginated layout on 1 to PAGE_BUDGET_MAX pages or print at the fixed scale
+        case GLFW_KEY_B:
+            if (action == GLFW_PRESS && !player.playing) {
+                _3d_objs_buffer->switch_page_budget();
+                glfwSetWindowTitle (window, "switch page budget");
+            }
+            break;
+        // print the vertex colours in the pdf export or leave the nets white
+        case GLFW_KEY_C:
+            if (action == GLFW_PRESS) {
+                bake_colors = !bake_colors;
+                glfwSetWindowTitle (window, bake_colors? "bake colours into the pdf" : "export white nets");
+            }
+            break;
+        // export the layout as the texture atlas of an obj
+        case GLFW_KEY_O:
+            if (action == GLFW_PRESS && !player.playing) {
+                glfwSetWindowTitle (window, "export OBJ atlas");
+                export_obj(_3d_objs_buffer->_3d_objs, EXPORT_OBJ_PATH);
+            }
+            break;
+        // switch the island layout between rectangle packing, nesting and pages
+        case GLFW_KEY_N:
+            if (action == GLFW_PRESS && !player.playing) {
+                _3d_objs_buffer->switch_layout_mode();
+                glfwSetWindowTitle (window, "switch island layout");
+            }
+            break;
         // play animation
         case GLFW_KEY_SPACE:
             if (action == GLFW_PRESS) {
                 if (_3d_objs_buffer->selected_obj != nullptr) {
                     glfwSetWindowTitle (window, "play animation");
+                    _3d_objs_buffer->selected_obj->finishUnfold();
                     player.init(_3d_objs_buffer->selected_obj);
                 }
             }
@@ -1693,10 +3420,14 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     }
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
     std::cout << std::setprecision(10);
 
+    // papercraft <input.off> <output.svg|pdf|dxf|plt|obj> exports the net without a window
+    if (argc == 3)
+        return export_headless(argv[1], argv[2]);
+
     GLFWwindow* window;
 
     // Initialize the library
@@ -1751,6 +3482,7 @@ int main(void)
     // A program controls the OpenGL pipeline and it must contains
     // at least a vertex shader and a fragment shader to be valid
     Program program;
+    // the islands are drawn with gl_VertexID/3 picking the animation matrix of each face from a texture buffer
     const GLchar* vertex_shader =
             "#version 410 core\n"
                     "in vec4 position;"
@@ -1759,30 +3491,59 @@ int main(void)
                     "uniform mat4 ModelMat;"
                     "uniform mat4 ProjectMat;"
                     "uniform mat4 AnimateT;"
+                    "uniform int animated;"
+                    "uniform samplerBuffer animations;"
+                    "out vec3 g_color;"
+                    "void main()"
+                    "{"
+                    "    mat4 A = AnimateT;"
+                    "    if (animated == 1) {"
+                    "        int f = 4*(gl_VertexID/3);"
+                    "        A = mat4(texelFetch(animations, f), texelFetch(animations, f+1), texelFetch(animations, f+2), texelFetch(animations, f+3));"
+                    "    }"
+                    "    gl_Position = ProjectMat*ViewMat*ModelMat*A*position;"
+                    "    g_color = color;"
+                    "}";
+    // every triangle gets the barycentric coordinates of its corners, so its edges are drawn in the same pass
+    const GLchar* geometry_shader =
+            "#version 410 core\n"
+                    "layout(triangles) in;"
+                    "layout(triangle_strip, max_vertices = 3) out;"
+                    "in vec3 g_color[];"
                     "out vec3 f_color;"
+                    "out vec3 bary;"
                     "void main()"
                     "{"
-                    "    gl_Position = ProjectMat*ViewMat*ModelMat*AnimateT*position;"
-                    "    f_color = color;"
+                    "    for (int k = 0; k < 3; k++) {"
+                    "        gl_Position = gl_in[k].gl_Position;"
+                    "        gl_PrimitiveID = gl_PrimitiveIDIn;"
+                    "        f_color = g_color[k];"
+                    "        bary = vec3(k == 0, k == 1, k == 2);"
+                    "        EmitVertex();"
+                    "    }"
+                    "    EndPrimitive();"
                     "}";
+    // the line colour within about a pixel of an edge, the faces of the 3d view take their colour from a
+    // texture buffer at gl_PrimitiveID
     const GLchar* fragment_shader =
             "#version 410 core\n"
                     "in vec3 f_color;"
+                    "in vec3 bary;"
                     "out vec4 outColor;"
                     "uniform vec3 lineColor;"
-                    "uniform int isLine;"
+                    "uniform int selectable;"
+                    "uniform samplerBuffer faceColors;"
                     "void main()"
                     "{"
-                    "    if (isLine == 1)"
-                    "       outColor = vec4(lineColor, 1.0);"
-                    "    else"
-                    "       outColor = vec4(f_color, 1.0);"
+                    "    vec3 color = selectable == 1? texelFetch(faceColors, gl_PrimitiveID).rgb : f_color;"
+                    "    vec3 edge = smoothstep(vec3(0.0), fwidth(bary), bary);"
+                    "    outColor = vec4(mix(lineColor, color, min(min(edge.x, edge.y), edge.z)), 1.0);"
                     "}";
 
-    // Compile the two shaders and upload the binary to the GPU
+    // Compile the shaders and upload the binary to the GPU
     // Note that we have to explicitly specify that the output "slot" called outColor
     // is the one that we want in the fragment buffer (and thus on screen)
-    program.init(vertex_shader,fragment_shader,"outColor");
+    program.init(vertex_shader,fragment_shader,"outColor",geometry_shader);
     program.bind();
 
     // Register the keyboard callback
@@ -1812,7 +3573,10 @@ int main(void)
     special_color = (BLACK.cast<double>())/255.0;
     // special_color = (WHITE.cast<double>())/255.0;
     glUniform3fv(program.uniform("lineColor"), 1, v_to_float(special_color).data());
-    Eigen::MatrixXd I44 = Eigen::MatrixXd::Identity(4,4);
+    glUniform1i(program.uniform("animations"), 0);
+    glUniform1i(program.uniform("faceColors"), 1);
+    Eigen::Matrix4f I44 = Eigen::Matrix4f::Identity();
+    Eigen::Vector3f white = WHITE.cast<float>()/255.f;
 
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(window))
@@ -1831,10 +3595,7 @@ int main(void)
 
         // Update window scaling
         camera_buf->updateWindowScale(window);
-        
-        // define render color
-        Eigen::Vector3d white = (WHITE.cast<double>())/255.0;
-        Eigen::Vector3d red = (RED.cast<double>())/255.0;
+
 
         int WindowWidth, WindowHeight;
         glfwGetWindowSize(window, &WindowWidth, &WindowHeight);
@@ -1845,34 +3606,28 @@ int main(void)
         Camera* rightCam = camera_buf->cameras[1];
         Eigen::Vector4d rightCamPos = to_4_point(rightCam->position);
         glUniform4fv(program.uniform("viewPosition"), 1, v_to_float(rightCamPos).data());
-        glUniformMatrix4fv(program.uniform("ViewMat"), 1, GL_FALSE, m_to_float(rightCam->ViewMat).data());
-        glUniformMatrix4fv(program.uniform("ProjectMat"), 1, GL_FALSE, m_to_float(rightCam->get_project_mat()).data());
+        glUniformMatrix4fv(program.uniform("ViewMat"), 1, GL_FALSE, rightCam->ViewMatF.data(rightCam->ViewMat));
+        glUniformMatrix4fv(program.uniform("ProjectMat"), 1, GL_FALSE, rightCam->ProjectMatF.data(rightCam->get_project_mat()));
 
-        if (player.playing) {
+        // the animation matrices only change while the animation plays, the last frame is uploaded too
+        bool animating = player.playing;
+        if (animating) {
             player.nextFrame();
         }
+        glUniform1i(program.uniform("animated"), 1);
+        glUniform1i(program.uniform("selectable"), 0);
+        glUniform3fv(program.uniform("color"), 1, white.data());
         for (auto obj: _3d_objs_buffer->_3d_objs) {
-            // prepare
-            for (FlattenObject &flatObj: obj->flattenObjs) {
-                glUniformMatrix4fv(program.uniform("ModelMat"), 1, GL_FALSE, m_to_float(flatObj.ModelMat).data());
+            obj->pollUnfold();
+            // one draw call per island
+            for (FlattenObject &flatObj: obj->shownIslands()) {
+                glUniformMatrix4fv(program.uniform("ModelMat"), 1, GL_FALSE, flatObj.ModelMatF.data(flatObj.ModelMat));
 
                 flatObj.VAO.bind();
                 program.bindVertexAttribArray("position", flatObj.VBO_P);
-                glUniform3fv(program.uniform("color"), 1, v_to_float(white).data());
-                for (int i = 0; i < flatObj.fV.cols(); i += 3) {
-                    // get animation model matrix
-                    int meshId = flatObj.idx2meshId[i];
-                    Mesh* mesh = flatObj.meshes[meshId];
-                    Eigen::Matrix4d AnimateT = mesh->animeM;
-                    // std::cout << "AnimateT" << std::endl;
-                    // std::cout << AnimateT << std::endl;
-                    glUniformMatrix4fv(program.uniform("AnimateT"), 1, GL_FALSE, m_to_float(AnimateT).data());
-
-                    glUniform1i(program.uniform("isLine"), 1);
-                    glDrawArrays(GL_LINE_LOOP, i, 3);
-                    glUniform1i(program.uniform("isLine"), 0);
-                    glDrawArrays(GL_TRIANGLES, i, 3);
-                }
+                if (animating) flatObj.uploadAnimation();
+                flatObj.TBO_A.bind(0);
+                glDrawArrays(GL_TRIANGLES, 0, flatObj.fV.cols());
             }
         }
 
@@ -1882,27 +3637,19 @@ int main(void)
         Camera* leftCam = camera_buf->cameras[0];
         Eigen::Vector4d leftCamPos = to_4_point(leftCam->position);
         glUniform4fv(program.uniform("viewPosition"), 1, v_to_float(leftCamPos).data());
-        glUniformMatrix4fv(program.uniform("ViewMat"), 1, GL_FALSE, m_to_float(leftCam->ViewMat).data());
-        glUniformMatrix4fv(program.uniform("ProjectMat"), 1, GL_FALSE, m_to_float(leftCam->get_project_mat()).data());
-        glUniformMatrix4fv(program.uniform("ViewMat"), 1, GL_FALSE, m_to_float(leftCam->ViewMat).data());
-        glUniformMatrix4fv(program.uniform("AnimateT"), 1, GL_FALSE, m_to_float(I44).data());
+        glUniformMatrix4fv(program.uniform("ViewMat"), 1, GL_FALSE, leftCam->ViewMatF.data(leftCam->ViewMat));
+        glUniformMatrix4fv(program.uniform("ProjectMat"), 1, GL_FALSE, leftCam->ProjectMatF.data(leftCam->get_project_mat()));
+        glUniformMatrix4fv(program.uniform("AnimateT"), 1, GL_FALSE, I44.data());
+        glUniform1i(program.uniform("animated"), 0);
+        glUniform1i(program.uniform("selectable"), 1);
 
+        // one indexed draw call per object, the selection is already in its face colours
         for (auto obj: _3d_objs_buffer->_3d_objs) {
             obj->VAO.bind();
             program.bindVertexAttribArray("position",obj->VBO_P);
-            glUniformMatrix4fv(program.uniform("ModelMat"), 1, GL_FALSE, m_to_float(obj->ModelMat).data());
-            for (int i = 0; i < obj->meshes.size(); i++) {
-                if (obj->selectedMeshes.find(i) != obj->selectedMeshes.end()) {
-                    glUniform3fv(program.uniform("color"), 1, v_to_float(red).data());
-                }
-                else {
-                    glUniform3fv(program.uniform("color"), 1, v_to_float(white).data());
-                }
-                glUniform1i(program.uniform("isLine"), 1);
-                glDrawElements(GL_LINE_LOOP, 3, GL_UNSIGNED_INT, (void*)(sizeof(int)* (i*3)));
-                glUniform1i(program.uniform("isLine"), 0);
-                glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, (void*)(sizeof(int)* (i*3)));
-            }
+            glUniformMatrix4fv(program.uniform("ModelMat"), 1, GL_FALSE, obj->ModelMatF.data(obj->ModelMat));
+            obj->TBO_S.bind(1);
+            glDrawElements(GL_TRIANGLES, obj->IDX.rows(), GL_UNSIGNED_INT, (void*)0);
         }
 
         // Swap front and back buffers